@@ -0,0 +1,76 @@
+#include "draw_batcher.h"
+#include "log.h"
+#include "profiler.h"
+
+namespace Greenbell {
+
+DrawBatcher::DrawBatcher(GLenum mode, GLenum index_type)
+        : mode_{mode}, index_type_{index_type} {
+}
+
+void DrawBatcher::clear() noexcept {
+    draws_.clear();
+    batches_.clear();
+    indirect_buffer_ = 0;
+}
+
+void DrawBatcher::add(GLuint program, GLuint vao, std::uint16_t state,
+        const GL::DEIC& command) {
+    draws_.push_back(Draw{program, vao, state, command});
+}
+
+bool DrawBatcher::build(StreamBuffer& indirect) {
+    GB_PROFILE_ZONE("DrawBatcher::build");
+    batches_.clear();
+    indirect_buffer_ = 0;
+    if (draws_.empty()) return true;
+
+    order_.resize(draws_.size());
+    for (std::size_t i = 0; i < draws_.size(); ++i) {
+        const auto& d = draws_[i];
+        order_[i] = SortItem{Key(d.program, d.vao, d.state),
+                static_cast<std::uint32_t>(i)};
+    }
+    RadixSort(order_, scratch_);
+
+    commands_.resize(draws_.size());
+    for (std::size_t i = 0; i < order_.size(); ++i) {
+        const auto& d = draws_[order_[i].index];
+        commands_[i] = d.command;
+        if (batches_.empty() || batches_.back().program != d.program ||
+                batches_.back().vao != d.vao ||
+                batches_.back().state != d.state) {
+            batches_.push_back(Batch{d.program, d.vao, d.state,
+                    static_cast<GLintptr>(i * sizeof(GL::DEIC)), 0});
+        }
+        ++batches_.back().count;
+    }
+
+    const auto allocation = indirect.write(commands_.data(),
+            commands_.size());
+    if (!allocation) {
+        Log::Write(LOG_ERROR, "DrawBatcher: No room for %d commands",
+                commands_.size());
+        batches_.clear();
+        return false;
+    }
+    for (auto& batch : batches_) batch.offset += allocation.offset;
+    indirect_buffer_ = indirect.name();
+    return true;
+}
+
+void DrawBatcher::begin_submit() const noexcept {
+    GL::State::BindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_);
+}
+
+void DrawBatcher::draw(std::size_t i) const noexcept {
+    // Consecutive batches often share these, which the state cache skips
+    const auto& batch = batches_[i];
+    GL::State::UseProgram(batch.program);
+    GL::State::BindVertexArray(batch.vao);
+    // The indirect "pointer" is an offset into the bound buffer
+    glMultiDrawElementsIndirect(mode_, index_type_,
+            reinterpret_cast<const void*>(batch.offset), batch.count, 0);
+}
+
+} // namespace Greenbell
@@ -0,0 +1,140 @@
+#include "frame_stats.h"
+#include <algorithm>
+
+namespace Greenbell {
+
+static std::chrono::microseconds Microseconds(std::uint64_t value) noexcept {
+    return std::chrono::microseconds(
+            static_cast<std::chrono::microseconds::rep>(value));
+}
+
+std::size_t FrameStats::BucketIndex(std::uint32_t value) noexcept {
+    if (value < 2 * SUB_BUCKETS) return value;
+    std::uint32_t exponent = 0;
+    while ((value >> exponent) > 1) ++exponent;
+    // The top bit is implied so the next 3 bits pick the sub bucket
+    const auto sub = (value >> (exponent - 3)) & (SUB_BUCKETS - 1);
+    return 2 * SUB_BUCKETS + (exponent - 4) * SUB_BUCKETS + sub;
+}
+
+std::uint32_t FrameStats::BucketValue(std::size_t index) noexcept {
+    if (index < 2 * SUB_BUCKETS) return static_cast<std::uint32_t>(index);
+    const auto offset = static_cast<std::uint32_t>(index - 2 * SUB_BUCKETS);
+    const auto shift = offset / SUB_BUCKETS + 1;
+    const auto sub = offset % SUB_BUCKETS;
+    // Middle of the bucket
+    return ((SUB_BUCKETS + sub) << shift) + ((1u << shift) >> 1);
+}
+
+void FrameStats::Record(Series& s, std::int64_t value) noexcept {
+    const auto v = static_cast<std::uint32_t>(std::clamp<std::int64_t>(
+            value, 0, MAX_VALUE));
+
+    // Only this thread writes so plain loads and stores are enough, they
+    // just need to be atomic for the readers
+    const auto count = s.count.load(std::memory_order_relaxed);
+    auto& slot = s.window[count % WINDOW];
+    if (count >= WINDOW) {
+        // Forget the sample falling out of the window
+        const auto old = slot.load(std::memory_order_relaxed);
+        s.buckets[BucketIndex(old)].fetch_sub(1, std::memory_order_relaxed);
+        s.sum.fetch_sub(old, std::memory_order_relaxed);
+    }
+    slot.store(v, std::memory_order_relaxed);
+    s.buckets[BucketIndex(v)].fetch_add(1, std::memory_order_relaxed);
+    s.sum.fetch_add(v, std::memory_order_relaxed);
+    s.count.store(count + 1, std::memory_order_release);
+}
+
+FrameCounterSummary FrameStats::Summary(const Series& s) noexcept {
+    FrameCounterSummary result;
+    const auto count = s.count.load(std::memory_order_acquire);
+    const auto samples = static_cast<std::size_t>(
+            std::min<std::uint64_t>(count, WINDOW));
+    if (samples == 0) return result;
+    result.samples = samples;
+
+    std::uint32_t max = 0;
+    for (std::size_t i = 0; i < samples; ++i) {
+        max = std::max(max, s.window[i].load(std::memory_order_relaxed));
+    }
+    result.max = max;
+    result.mean = s.sum.load(std::memory_order_relaxed) / samples;
+
+    // Copy the histogram so every percentile sees the same one. The total
+    // comes from the copy too in case a sample was recorded meanwhile.
+    std::uint32_t buckets[BUCKET_COUNT];
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+        buckets[i] = s.buckets[i].load(std::memory_order_relaxed);
+        total += buckets[i];
+    }
+    const auto percentile = [&buckets, total](std::uint64_t percent) {
+        // Smallest bucket holding at least percent of the samples
+        const auto rank = std::max<std::uint64_t>(1,
+                (total * percent + 99) / 100);
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) return std::uint64_t{BucketValue(i)};
+        }
+        return std::uint64_t{0};
+    };
+    result.p50 = percentile(50);
+    result.p95 = percentile(95);
+    result.p99 = percentile(99);
+
+    // A percentile can't be past the max, which is exact
+    result.p50 = std::min(result.p50, result.max);
+    result.p95 = std::min(result.p95, result.max);
+    result.p99 = std::min(result.p99, result.max);
+    return result;
+}
+
+std::uint64_t FrameStats::Last(const Series& s) noexcept {
+    const auto count = s.count.load(std::memory_order_acquire);
+    if (count == 0) return 0;
+    return s.window[(count - 1) % WINDOW].load(std::memory_order_relaxed);
+}
+
+void FrameStats::record(FrameMetric metric,
+        std::chrono::microseconds value) noexcept {
+    Record(series_[static_cast<std::size_t>(metric)], value.count());
+}
+
+void FrameStats::record(FrameCounter counter, std::uint64_t value) noexcept {
+    Record(counters_[static_cast<std::size_t>(counter)],
+            static_cast<std::int64_t>(std::min<std::uint64_t>(value,
+                    MAX_VALUE)));
+}
+
+FrameStatsSummary FrameStats::summary(FrameMetric metric) const noexcept {
+    const auto s = Summary(series_[static_cast<std::size_t>(metric)]);
+    return FrameStatsSummary{Microseconds(s.mean), Microseconds(s.p50),
+            Microseconds(s.p95), Microseconds(s.p99), Microseconds(s.max),
+            s.samples};
+}
+
+FrameCounterSummary FrameStats::summary(FrameCounter counter) const noexcept {
+    return Summary(counters_[static_cast<std::size_t>(counter)]);
+}
+
+std::chrono::microseconds FrameStats::last(FrameMetric metric) const noexcept {
+    return Microseconds(Last(series_[static_cast<std::size_t>(metric)]));
+}
+
+std::uint64_t FrameStats::last(FrameCounter counter) const noexcept {
+    return Last(counters_[static_cast<std::size_t>(counter)]);
+}
+
+std::uint64_t FrameStats::count(FrameMetric metric) const noexcept {
+    return series_[static_cast<std::size_t>(metric)].count.load(
+            std::memory_order_relaxed);
+}
+
+std::uint64_t FrameStats::count(FrameCounter counter) const noexcept {
+    return counters_[static_cast<std::size_t>(counter)].count.load(
+            std::memory_order_relaxed);
+}
+
+} // namespace Greenbell
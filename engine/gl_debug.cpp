@@ -0,0 +1,148 @@
+#include "gl_debug.h"
+#include "log.h"
+#include "profiler.h"
+#include <stdexcept>
+
+namespace Greenbell {
+
+static LogLevel MessageLevel(GLenum type, GLenum severity) noexcept {
+    if (type == GL_DEBUG_TYPE_ERROR || severity == GL_DEBUG_SEVERITY_HIGH) {
+        return LOG_ERROR;
+    }
+    return (severity == GL_DEBUG_SEVERITY_NOTIFICATION) ? LOG_TRACE : LOG_INFO;
+}
+
+GLDebugMessages::GLDebugMessages(std::chrono::milliseconds interval)
+        : interval_{interval}, next_report_{Clock::now() + interval} {
+}
+
+GLDebugMessages::~GLDebugMessages() {
+    if (installed_) uninstall();
+}
+
+void GLDebugMessages::install(bool synchronous) {
+    glEnable(GL_DEBUG_OUTPUT);
+    if (synchronous) {
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    } else {
+        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    }
+    glDebugMessageCallback(Callback, this);
+    installed_ = true;
+}
+
+void GLDebugMessages::uninstall() {
+    glDebugMessageCallback(nullptr, nullptr);
+    installed_ = false;
+}
+
+void GLDebugMessages::mute(GLenum source, GLenum type, GLuint id,
+        bool muted) {
+    glDebugMessageControl(source, type, GL_DONT_CARE, 1, &id,
+            muted ? GL_FALSE : GL_TRUE);
+}
+
+void GLDebugMessages::filter(GLenum source, GLenum type, GLenum severity,
+        bool enabled) {
+    glDebugMessageControl(source, type, severity, 0, nullptr,
+            enabled ? GL_TRUE : GL_FALSE);
+}
+
+std::uint64_t GLDebugMessages::Key(GLenum source, GLenum type,
+        GLuint id) noexcept {
+    // The enums are all well under 16 bits
+    return (static_cast<std::uint64_t>(source & 0xFFFF) << 48) |
+            (static_cast<std::uint64_t>(type & 0xFFFF) << 32) | id;
+}
+
+void APIENTRY GLDebugMessages::Callback(GLenum source, GLenum type,
+        GLuint id, GLenum severity, GLsizei /* length */,
+        const GLchar* message, const void* user_param) {
+    static_cast<const GLDebugMessages*>(user_param)->receive(source, type, id,
+            severity, message);
+}
+
+void GLDebugMessages::receive(GLenum source, GLenum type, GLuint id,
+        GLenum severity, const GLchar* message) const {
+    [[maybe_unused]] const auto now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        const auto [it, added] = entries_.try_emplace(Key(source, type, id));
+        auto& e = it->second;
+        if (added) {
+            e.source = source;
+            e.type = type;
+            e.severity = severity;
+            e.id = id;
+            e.message = message ? message : "";
+        }
+        ++e.total;
+        if (!added) {
+            if (e.shown) ++e.repeats;
+        } else if (new_this_interval_ < NEW_LIMIT) {
+            show(e);
+        } else {
+            ++waiting_;
+        }
+
+        // Zero length zone marking when the driver complained. The name is
+        // kept in the entry so it lives long enough for the trace.
+        if (type == GL_DEBUG_TYPE_PERFORMANCE) {
+            GB_PROFILE_RECORD(e.message.c_str(), now, now);
+        }
+    }
+    if (type == GL_DEBUG_TYPE_ERROR && throw_on_error_) {
+        throw std::runtime_error("OpenGL Error");
+    }
+}
+
+// Log the first time a message was seen. Called with the mutex held.
+void GLDebugMessages::show(Entry& e) const {
+    ++new_this_interval_;
+    e.shown = true;
+    if (e.total > 1) {
+        // Waited for an interval with room, and repeated meanwhile
+        Log::Write(MessageLevel(e.type, e.severity),
+                "GL %s %s %s %d: %s (seen %d times)",
+                Log::DebugSourceName(e.source), Log::DebugTypeName(e.type),
+                Log::DebugSeverityName(e.severity), e.id, e.message, e.total);
+    } else {
+        Log::Write(MessageLevel(e.type, e.severity), "GL %s %s %s %d: %s",
+                Log::DebugSourceName(e.source), Log::DebugTypeName(e.type),
+                Log::DebugSeverityName(e.severity), e.id, e.message);
+    }
+}
+
+void GLDebugMessages::update() {
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (now < next_report_) return;
+    next_report_ = now + interval_;
+    new_this_interval_ = 0;
+    for (auto& [key, e] : entries_) {
+        if (!e.shown && waiting_ && new_this_interval_ < NEW_LIMIT) {
+            show(e);
+            --waiting_;
+        }
+        if (e.repeats == 0) continue;
+        Log::Write(MessageLevel(e.type, e.severity),
+                "GL %s %s %s %d: repeated %d times (%d total): %s",
+                Log::DebugSourceName(e.source), Log::DebugTypeName(e.type),
+                Log::DebugSeverityName(e.severity), e.id, e.repeats, e.total,
+                e.message);
+        e.repeats = 0;
+    }
+    if (waiting_) {
+        Log::Write(LOG_INFO, "GL %d more new debug messages to show later",
+                waiting_);
+    }
+}
+
+std::uint64_t GLDebugMessages::count(GLenum source, GLenum type,
+        GLuint id) const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    const auto it = entries_.find(Key(source, type, id));
+    return (it == entries_.end()) ? 0 : it->second.total;
+}
+
+} // namespace Greenbell
@@ -0,0 +1,78 @@
+#include "gl_state.h"
+#include "log.h"
+
+namespace Greenbell::GL::State {
+
+static GLuint Actual(GLenum what, GLint index) {
+    switch (what) {
+        case GL_DEPTH_TEST:
+        case GL_BLEND:
+        case GL_CULL_FACE:
+            return glIsEnabled(what);
+        case GL_SAMPLER_BINDING: {
+            // Only readable for the active texture unit
+            GLint active = 0;
+            glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+            glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(index));
+            GLint value = 0;
+            glGetIntegerv(what, &value);
+            glActiveTexture(static_cast<GLenum>(active));
+            return static_cast<GLuint>(value);
+        }
+        case GL_BLEND_SRC_RGB: {
+            GLint source = 0;
+            GLint destination = 0;
+            glGetIntegerv(GL_BLEND_SRC_RGB, &source);
+            glGetIntegerv(GL_BLEND_DST_RGB, &destination);
+            return (static_cast<GLuint>(source) << 16) |
+                    static_cast<GLuint>(destination);
+        }
+        default: {
+            // Some, like GL_POLYGON_MODE, can return two values
+            GLint value[2] = {0, 0};
+            glGetIntegerv(what, value);
+            return static_cast<GLuint>(value[0]);
+        }
+    }
+}
+
+void VerifyValue(GLenum what, GLint index, GLuint expected) {
+    if (expected == UNKNOWN) return;
+    const auto actual = Actual(what, index);
+    if (actual != expected) {
+        Log::Write(LOG_ERROR, "GL::State: %d[%d] is %d but expected %d",
+                what, index, actual, expected);
+    }
+}
+
+std::size_t Verify() {
+    std::size_t errors = 0;
+    const auto check = [&errors](GLenum what, GLint index, GLuint expected) {
+        if (expected == UNKNOWN || Actual(what, index) == expected) return;
+        VerifyValue(what, index, expected); // Logs it
+        ++errors;
+    };
+
+    const auto& s = tl_shadow;
+    check(GL_CURRENT_PROGRAM, -1, s.program);
+    check(GL_VERTEX_ARRAY_BINDING, -1, s.vao);
+    check(GL_ARRAY_BUFFER_BINDING, -1, s.buffers[ARRAY]);
+    check(GL_ELEMENT_ARRAY_BUFFER_BINDING, -1, s.buffers[ELEMENT_ARRAY]);
+    check(GL_UNIFORM_BUFFER_BINDING, -1, s.buffers[UNIFORM]);
+    check(GL_DRAW_INDIRECT_BUFFER_BINDING, -1, s.buffers[DRAW_INDIRECT]);
+    for (std::size_t i = 0; i < SAMPLER_UNITS; ++i) {
+        check(GL_SAMPLER_BINDING, static_cast<GLint>(i), s.samplers[i]);
+    }
+    check(GL_DEPTH_TEST, -1, s.capabilities[DEPTH_TEST]);
+    check(GL_BLEND, -1, s.capabilities[BLEND]);
+    check(GL_CULL_FACE, -1, s.capabilities[CULL_FACE]);
+    check(GL_CULL_FACE_MODE, -1, s.cull_face);
+    check(GL_POLYGON_MODE, -1, s.polygon_mode);
+    check(GL_DEPTH_WRITEMASK, -1, s.depth_mask);
+    check(GL_DEPTH_FUNC, -1, s.depth_func);
+    check(GL_BLEND_SRC_RGB, -1, s.blend_func);
+    check(GL_BLEND_EQUATION_RGB, -1, s.blend_equation);
+    return errors;
+}
+
+} // namespace Greenbell::GL::State
@@ -0,0 +1,82 @@
+#include "gpu_profiler.h"
+
+namespace Greenbell {
+
+static std::chrono::microseconds ToMicroseconds(GLuint64 begin,
+        GLuint64 end) noexcept {
+    // Timestamps are in nanoseconds
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::nanoseconds(static_cast<std::int64_t>(end - begin)));
+}
+
+GpuProfiler::GpuProfiler(std::size_t frames) : frames_(frames ? frames : 1) {
+}
+
+void GpuProfiler::begin_frame() {
+    auto& f = frames_[current_];
+    ++frame_count_;
+    if (f.pending && !collect(f)) {
+        // The GPU is still busy with this slot's frame
+        recording_ = false;
+        ++dropped_;
+        return;
+    }
+    recording_ = true;
+    depth_ = 0;
+    f.used = 0;
+    f.scopes.clear();
+    f.number = frame_count_;
+    timestamp(f);
+}
+
+void GpuProfiler::end_frame(std::chrono::microseconds cpu_time) {
+    if (!recording_) return; // Try the same slot again next frame
+    auto& f = frames_[current_];
+    timestamp(f);
+    f.cpu_time = cpu_time;
+    f.pending = true;
+    recording_ = false;
+    current_ = (current_ + 1) % frames_.size();
+}
+
+std::size_t GpuProfiler::begin(const char* name) {
+    if (!recording_) return NO_SCOPE;
+    auto& f = frames_[current_];
+    f.scopes.push_back(Scope{name, timestamp(f), 0, depth_++});
+    return f.scopes.size() - 1;
+}
+
+void GpuProfiler::end(std::size_t scope) {
+    if (!recording_ || scope == NO_SCOPE) return;
+    auto& f = frames_[current_];
+    f.scopes[scope].end = timestamp(f);
+    --depth_;
+}
+
+std::size_t GpuProfiler::timestamp(Frame& f) {
+    if (f.used == f.queries.size()) f.queries.emplace_back();
+    f.queries[f.used].timestamp();
+    return f.used++;
+}
+
+bool GpuProfiler::collect(Frame& f) {
+    // Timestamps complete in order so if the last one is available they
+    // all are
+    if (!f.queries[f.used - 1].available()) return false;
+
+    passes_.clear();
+    for (const auto& scope : f.scopes) {
+        passes_.push_back(PassTime{scope.name,
+                ToMicroseconds(f.queries[scope.begin].result(),
+                        f.queries[scope.end].result()),
+                scope.depth});
+    }
+    gpu_time_ = ToMicroseconds(f.queries[0].result(),
+            f.queries[f.used - 1].result());
+    cpu_time_ = f.cpu_time;
+    frame_ = f.number;
+    f.pending = false;
+    return true;
+}
+
+} // namespace Greenbell
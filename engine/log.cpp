@@ -1,12 +1,30 @@
 #include "log.h"
 #include "glad.h"
 #include "gb_fmt.h"
+#include "log_file.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
 #include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace Greenbell::Log {
 
 static LogLevel level_ = LOG_INFO;
 
+// Held while writing to the console so messages don't interleave
+static std::mutex output_mutex_;
+
 void SetLevel(LogLevel level) {
     level_ = level;
 }
@@ -15,6 +33,576 @@ LogLevel Level() {
     return level_;
 }
 
+std::ostringstream& FormatStream() {
+    static thread_local std::ostringstream stream;
+    stream.str({});
+    return stream;
+}
+
+// A message or record taken from a ring
+struct LogEntry {
+    std::uint32_t kind;
+    std::int64_t time;
+    const char* p_data;
+    std::size_t size;
+};
+
+// Messages from one thread waiting for the background thread. Each is a
+// 16 byte header followed by the text, padded to a multiple of the header
+// size. Every entry then starts on a header boundary, so there is always
+// room before the end for at least the header which skips to the start.
+class LogRing {
+  public:
+    explicit LogRing(std::uint32_t thread_id) noexcept : id{thread_id} {}
+
+    static constexpr std::size_t SIZE = 1 << 16;
+    static constexpr std::size_t MAX_MESSAGE = SIZE / 4; // Longer is cut
+
+    // Kind for a GB_LOG record, which starts with its LogFormat pointer.
+    // Text messages use their level as the kind.
+    static constexpr std::uint32_t RECORD = 0x100;
+
+    // Space for size bytes of the given kind, or nullptr if there is no
+    // room. Only called by the owning thread and must be followed by commit.
+    char* reserve(std::size_t size, std::uint32_t kind) noexcept {
+        if (size > MAX_MESSAGE) return nullptr;
+        const auto need = sizeof(Header) + Padded(size);
+        const auto head = head_.load(std::memory_order_relaxed);
+        const auto used = head - tail_.load(std::memory_order_acquire);
+        const auto pos = head % SIZE;
+
+        // Skip to the start if the message doesn't fit before the end
+        const auto skip = (need > SIZE - pos) ? SIZE - pos : 0;
+        if (skip + need > SIZE - used) return nullptr;
+        if (skip) {
+            write_header(pos, Header{static_cast<std::uint32_t>(skip),
+                    PADDING, 0});
+        }
+        const auto start = (pos + skip) % SIZE;
+        write_header(start, Header{static_cast<std::uint32_t>(size), kind,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count()});
+        reserved_head_ = head + skip + need;
+        return &p_data_[start + sizeof(Header)];
+    }
+    void commit() noexcept {
+        head_.store(reserved_head_, std::memory_order_release);
+    }
+
+    // False if there was no room
+    bool push(LogLevel level, std::string_view message) noexcept {
+        const auto length = std::min(message.size(), MAX_MESSAGE);
+        auto* p = reserve(length, static_cast<std::uint32_t>(level));
+        if (!p) return false;
+        std::memcpy(p, message.data(), length);
+        commit();
+        return true;
+    }
+
+    // Only called by the background thread. Calls visit with each LogEntry.
+    template <typename F>
+    void drain(F&& visit) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        const auto head = head_.load(std::memory_order_acquire);
+        while (tail != head) {
+            const auto pos = tail % SIZE;
+            Header header;
+            std::memcpy(&header, &p_data_[pos], sizeof(Header));
+            if (header.kind == PADDING) {
+                tail += header.size;
+                continue;
+            }
+            visit(LogEntry{header.kind, header.time,
+                    &p_data_[pos + sizeof(Header)], header.size});
+            tail += sizeof(Header) + Padded(header.size);
+        }
+        tail_.store(tail, std::memory_order_release);
+    }
+
+    bool empty() const noexcept {
+        return head_.load(std::memory_order_acquire) ==
+                tail_.load(std::memory_order_relaxed);
+    }
+
+    // Set when the owning thread exits so the ring can be deleted once the
+    // background thread has emptied it
+    std::atomic<bool> closed{false};
+    // Set by the owning thread while it writes, so stopping can wait for it
+    std::atomic<bool> in_use{false};
+    const std::uint32_t id; // Thread number for binary logs
+
+  private:
+    struct Header {
+        std::uint32_t size;
+        std::uint32_t kind;
+        std::int64_t time;
+    };
+    static constexpr std::uint32_t PADDING = ~0u;
+
+    static constexpr std::size_t Padded(std::size_t size) noexcept {
+        return (size + sizeof(Header) - 1) & ~(sizeof(Header) - 1);
+    }
+    static_assert(SIZE % sizeof(Header) == 0);
+    void write_header(std::size_t pos, Header header) noexcept {
+        std::memcpy(&p_data_[pos], &header, sizeof(Header));
+    }
+
+    std::unique_ptr<char[]> p_data_{std::make_unique<char[]>(SIZE)};
+    std::size_t reserved_head_{0}; // Only used by the owning thread
+    alignas(64) std::atomic<std::size_t> head_{0}; // Bytes ever written
+    alignas(64) std::atomic<std::size_t> tail_{0}; // Bytes ever read
+};
+
+// Owns the background thread and every thread's ring
+class AsyncWriter {
+  public:
+    AsyncWriter() = default;
+    ~AsyncWriter() {
+        stop(); // A joinable std::thread can't be destroyed
+    }
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+    AsyncWriter(AsyncWriter&&) = delete;
+    AsyncWriter& operator=(AsyncWriter&&) = delete;
+
+    bool running() const noexcept {
+        return running_.load(std::memory_order_acquire);
+    }
+
+    void start() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (thread_.joinable()) return;
+        quit_ = false;
+        thread_ = std::thread(&AsyncWriter::thread_handler, this);
+        running_.store(true, std::memory_order_release);
+    }
+
+    void stop() {
+        // Any thread which saw it running before this is still writing to
+        // its ring, so wait for them to finish. Rings made after this see
+        // it stopped, since making one takes rings_mutex_.
+        running_.store(false, std::memory_order_seq_cst);
+        {
+            std::lock_guard<std::mutex> lock{rings_mutex_};
+            for (const auto& p_ring : rings_) {
+                while (p_ring->in_use.load(std::memory_order_seq_cst)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            quit_ = true;
+            cv_.notify_all();
+        }
+        if (thread_.joinable()) {
+            thread_.join();
+            write_batch(); // Everything left, now nothing else can write
+        }
+        std::lock_guard<std::mutex> lock{sink_mutex_};
+        if (binary_.is_open()) binary_.close();
+    }
+
+    void open_binary(const std::string& path) {
+        {
+            std::lock_guard<std::mutex> lock{sink_mutex_};
+            if (binary_.is_open()) binary_.close();
+            binary_.open(path, std::ios::binary | std::ios::trunc);
+            if (!binary_) {
+                throw std::runtime_error("Can't open binary log " + path);
+            }
+            binary_.write(LogFile::MAGIC, sizeof(LogFile::MAGIC));
+            format_ids_.clear();
+        }
+        start();
+    }
+
+    void close_binary() {
+        flush();
+        std::lock_guard<std::mutex> lock{sink_mutex_};
+        if (binary_.is_open()) binary_.close();
+    }
+
+    void flush() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        if (!thread_.joinable()) return;
+        const auto target = ++flush_requested_;
+        cv_.notify_all();
+        done_cv_.wait(lock, [this, target]() {
+            return flush_done_ >= target;
+        });
+    }
+
+    // The calling thread's ring
+    LogRing& ring() {
+        if (!tl_owner.p_ring) {
+            std::lock_guard<std::mutex> lock{rings_mutex_};
+            rings_.push_back(std::make_unique<LogRing>(next_ring_id_++));
+            tl_owner.p_ring = rings_.back().get();
+        }
+        return *tl_owner.p_ring;
+    }
+
+    // The calling thread's ring marked in use, or nullptr if not running.
+    // Must be followed by leave.
+    LogRing* enter() {
+        if (!running()) return nullptr;
+        auto& r = ring();
+        r.in_use.store(true, std::memory_order_seq_cst);
+        if (running_.load(std::memory_order_seq_cst)) return &r;
+        r.in_use.store(false, std::memory_order_release); // Stopped meanwhile
+        return nullptr;
+    }
+    static void leave(LogRing& r) noexcept {
+        r.in_use.store(false, std::memory_order_release);
+    }
+
+    // False if not running
+    bool push(LogLevel level, std::string_view message) {
+        auto* p_ring = enter();
+        if (!p_ring) return false;
+        if (!p_ring->push(level, message)) drop();
+        leave(*p_ring);
+        return true;
+    }
+
+    void drop() noexcept {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t dropped() const noexcept {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    // Marks the thread's ring closed when the thread exits
+    struct RingOwner {
+        LogRing* p_ring{nullptr};
+        ~RingOwner() {
+            if (p_ring) p_ring->closed.store(true, std::memory_order_release);
+        }
+    };
+    static thread_local RingOwner tl_owner;
+
+    // How long the background thread waits before writing out a batch
+    static constexpr auto BATCH_INTERVAL = std::chrono::milliseconds(10);
+
+    std::mutex rings_mutex_;
+    std::vector<std::unique_ptr<LogRing>> rings_;
+    std::uint32_t next_ring_id_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<bool> running_{false};
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable done_cv_;
+    bool quit_{false};
+    std::uint64_t flush_requested_{0};
+    std::uint64_t flush_done_{0};
+
+    // Binary log file, held while writing a batch
+    std::mutex sink_mutex_;
+    std::ofstream binary_;
+    std::unordered_map<const LogFormat*, std::uint32_t> format_ids_;
+
+    // Only used by write_batch, which is the background thread until stop
+    // has joined it
+    std::string out_;
+    std::string err_;
+    std::string bin_;
+    std::uint64_t reported_dropped_{0};
+
+    template <typename T>
+    void append(T value) {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        bin_.append(bytes, sizeof(T));
+    }
+
+    void append_format(std::uint32_t id, const LogFormat& format) {
+        append(LogFile::FORMAT);
+        append(id);
+        append(static_cast<std::uint8_t>(format.level));
+        const auto length = std::strlen(format.format);
+        append(static_cast<std::uint32_t>(length));
+        bin_.append(format.format, length);
+        append(static_cast<std::uint32_t>(format.piece_count));
+        for (std::size_t i = 0; i < format.piece_count; ++i) {
+            append(format.p_pieces[i].offset);
+            append(format.p_pieces[i].length);
+            append(static_cast<std::uint8_t>(format.p_pieces[i].arg));
+        }
+        append(static_cast<std::uint32_t>(format.arg_count));
+        for (std::size_t i = 0; i < format.arg_count; ++i) {
+            append(static_cast<std::uint8_t>(format.p_args[i]));
+        }
+    }
+
+    void append_entry(std::uint32_t thread, const LogEntry& entry,
+            const LogFormat* p_format, LogLevel level) {
+        if (p_format) {
+            // Formats are written the first time they're used
+            const auto [it, added] = format_ids_.try_emplace(p_format,
+                    static_cast<std::uint32_t>(format_ids_.size()));
+            if (added) append_format(it->second, *p_format);
+            append(LogFile::RECORD);
+            append(it->second);
+        } else {
+            append(LogFile::TEXT);
+            append(static_cast<std::uint8_t>(level));
+        }
+        const auto skip = p_format ? sizeof(p_format) : 0;
+        append(thread);
+        append(entry.time);
+        append(static_cast<std::uint32_t>(entry.size - skip));
+        bin_.append(entry.p_data + skip, entry.size - skip);
+    }
+
+    void write_batch() {
+        std::lock_guard<std::mutex> sink_lock{sink_mutex_};
+        const auto binary = binary_.is_open();
+        {
+            std::lock_guard<std::mutex> lock{rings_mutex_};
+            for (auto it = rings_.begin(); it != rings_.end();) {
+                auto& ring = **it;
+                const auto closed = ring.closed.load(std::memory_order_acquire);
+                ring.drain([this, binary, &ring](const LogEntry& entry) {
+                    const LogFormat* p_format = nullptr;
+                    auto level = static_cast<LogLevel>(entry.kind);
+                    if (entry.kind == LogRing::RECORD) {
+                        std::memcpy(&p_format, entry.p_data, sizeof(p_format));
+                        level = p_format->level;
+                    }
+                    if (binary) append_entry(ring.id, entry, p_format, level);
+
+                    // Errors still go to the console with a binary log
+                    if (binary && level != LOG_ERROR) return;
+                    auto& text = (level == LOG_ERROR) ? err_ : out_;
+                    if (p_format) {
+                        DecodeRecord(*p_format, entry.p_data + sizeof(p_format),
+                                entry.size - sizeof(p_format), text);
+                    } else {
+                        text.append(entry.p_data, entry.size);
+                    }
+                    text += '\n';
+                });
+                if (closed && ring.empty()) {
+                    it = rings_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        const auto dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != reported_dropped_) {
+            err_ += "Log dropped " + std::to_string(dropped -
+                    reported_dropped_) + " messages\n";
+            if (binary) {
+                append(LogFile::DROPPED);
+                append(dropped - reported_dropped_);
+            }
+            reported_dropped_ = dropped;
+        }
+        if (!bin_.empty()) {
+            binary_.write(bin_.data(), static_cast<std::streamsize>(
+                    bin_.size()));
+            binary_.flush();
+            bin_.clear();
+        }
+
+        std::lock_guard<std::mutex> lock{output_mutex_};
+        if (!out_.empty()) {
+            std::cout << out_;
+            std::cout.flush();
+            out_.clear();
+        }
+        if (!err_.empty()) {
+            std::cerr << err_;
+            err_.clear();
+        }
+    }
+
+    void thread_handler() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        for (;;) {
+            cv_.wait_for(lock, BATCH_INTERVAL, [this]() {
+                return (quit_ || flush_requested_ != flush_done_);
+            });
+            const auto target = flush_requested_;
+            const auto quit = quit_;
+            lock.unlock();
+            write_batch();
+            lock.lock();
+            flush_done_ = target;
+            done_cv_.notify_all();
+            if (quit) break;
+        }
+    }
+};
+
+thread_local AsyncWriter::RingOwner AsyncWriter::tl_owner;
+
+static AsyncWriter async_writer_;
+
+void Output(LogLevel level, std::string_view message) {
+    if (async_writer_.push(level, message)) return;
+    std::lock_guard<std::mutex> lock{output_mutex_};
+    auto& os = (level == LOG_ERROR) ? std::cerr : std::cout;
+    os << message << "\n";
+}
+
+void StartAsync() {
+    async_writer_.start();
+}
+
+void StopAsync() {
+    async_writer_.stop();
+}
+
+void Flush() {
+    if (async_writer_.running()) {
+        async_writer_.flush();
+    } else {
+        std::lock_guard<std::mutex> lock{output_mutex_};
+        std::cout.flush();
+    }
+}
+
+std::uint64_t Dropped() {
+    return async_writer_.dropped();
+}
+
+void OpenBinary(const std::string& path) {
+    async_writer_.open_binary(path);
+}
+
+void CloseBinary() {
+    async_writer_.close_binary();
+}
+
+// The GB_LOG record being filled in by this thread. Records go straight into
+// the ring, or if it is full or not running into a scratch buffer.
+static thread_local const LogFormat* tl_format = nullptr;
+static thread_local LogRing* tl_record_ring = nullptr;
+static thread_local bool tl_record_sync = false;
+static thread_local std::vector<char> tl_scratch;
+
+char* ReserveRecord(const LogFormat& format, std::size_t size) {
+    tl_format = &format;
+    tl_record_ring = nullptr;
+    auto* p_ring = async_writer_.enter();
+    tl_record_sync = !p_ring;
+    if (p_ring) {
+        // Left in use until CommitRecord
+        const auto* p_format = &format;
+        auto* p = p_ring->reserve(sizeof(p_format) + size, LogRing::RECORD);
+        if (p) {
+            std::memcpy(p, &p_format, sizeof(p_format));
+            tl_record_ring = p_ring;
+            return p + sizeof(p_format);
+        }
+        AsyncWriter::leave(*p_ring);
+        async_writer_.drop();
+    }
+    tl_scratch.resize(size);
+    return tl_scratch.data();
+}
+
+void CommitRecord() {
+    if (tl_record_ring) {
+        tl_record_ring->commit();
+        AsyncWriter::leave(*tl_record_ring);
+        tl_record_ring = nullptr;
+    } else if (tl_record_sync) {
+        static thread_local std::string text;
+        text.clear();
+        DecodeRecord(*tl_format, tl_scratch.data(), tl_scratch.size(), text);
+        Output(tl_format->level, text);
+    }
+}
+
+// False if there isn't a T before p_end
+template <typename T>
+static bool Get(const char*& p, const char* p_end, T& value) noexcept {
+    if (static_cast<std::size_t>(p_end - p) < sizeof(T)) return false;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+bool DecodeRecord(const LogFormat& format, const char* p_data,
+        std::size_t size, std::string& text) {
+    // Numbers are written the same way operator<< would by default
+    char number[32];
+    const auto* p_end = p_data + size;
+    std::size_t arg = 0;
+    for (std::size_t i = 0; i < format.piece_count; ++i) {
+        const auto& piece = format.p_pieces[i];
+        text.append(format.format + piece.offset, piece.length);
+        if (!piece.arg) continue;
+        if (arg == format.arg_count) return false;
+        bool ok = false;
+        switch (format.p_args[arg++]) {
+            case LogArg::BOOL: {
+                char value = 0;
+                ok = Get(p_data, p_end, value);
+                text += value ? '1' : '0';
+                break;
+            }
+            case LogArg::CHAR: {
+                char value = 0;
+                ok = Get(p_data, p_end, value);
+                text += value;
+                break;
+            }
+            case LogArg::INT: {
+                std::int64_t value = 0;
+                ok = Get(p_data, p_end, value);
+                std::snprintf(number, sizeof(number), "%lld",
+                        static_cast<long long>(value));
+                text += number;
+                break;
+            }
+            case LogArg::UINT: {
+                std::uint64_t value = 0;
+                ok = Get(p_data, p_end, value);
+                std::snprintf(number, sizeof(number), "%llu",
+                        static_cast<unsigned long long>(value));
+                text += number;
+                break;
+            }
+            case LogArg::FLOAT: {
+                double value = 0.0;
+                ok = Get(p_data, p_end, value);
+                std::snprintf(number, sizeof(number), "%g", value);
+                text += number;
+                break;
+            }
+            case LogArg::POINTER: {
+                std::uintptr_t value = 0;
+                ok = Get(p_data, p_end, value);
+                std::snprintf(number, sizeof(number), "0x%llx",
+                        static_cast<unsigned long long>(value));
+                text += number;
+                break;
+            }
+            case LogArg::STRING: {
+                std::uint32_t length = 0;
+                ok = Get(p_data, p_end, length) &&
+                        length <= static_cast<std::size_t>(p_end - p_data);
+                if (ok) {
+                    text.append(p_data, length);
+                    p_data += length;
+                }
+                break;
+            }
+        }
+        if (!ok) return false;
+    }
+    return p_data == p_end;
+}
+
 void WriteGLError(unsigned int error) {
     std::cout << "OpenGL Error: ";
     switch (error) {
@@ -51,44 +639,45 @@ void WriteGLError(unsigned int error) {
 
 // Based on CC0 licensed
 //  https://github.com/fendevel/Guide-to-Modern-OpenGL-Functions
+const char* DebugSourceName(GLenum source) noexcept {
+    switch (source) {
+        case GL_DEBUG_SOURCE_API: return "API";
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "Window System";
+        case GL_DEBUG_SOURCE_SHADER_COMPILER: return "Shader Compiler";
+        case GL_DEBUG_SOURCE_THIRD_PARTY: return "Third Party";
+        case GL_DEBUG_SOURCE_APPLICATION: return "Application";
+        default: return "Other";
+    }
+}
+
+const char* DebugTypeName(GLenum type) noexcept {
+    switch (type) {
+        case GL_DEBUG_TYPE_ERROR: return "Error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+                return "Deprecated Behaviour";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "Undefined Behaviour";
+        case GL_DEBUG_TYPE_PORTABILITY: return "Portability";
+        case GL_DEBUG_TYPE_PERFORMANCE: return "Performance";
+        case GL_DEBUG_TYPE_MARKER: return "Marker";
+        default: return "Other";
+    }
+}
+
+const char* DebugSeverityName(GLenum severity) noexcept {
+    switch (severity) {
+        case GL_DEBUG_SEVERITY_NOTIFICATION: return "Note";
+        case GL_DEBUG_SEVERITY_LOW: return "Low";
+        case GL_DEBUG_SEVERITY_MEDIUM: return "Medium";
+        case GL_DEBUG_SEVERITY_HIGH: return "HIGH";
+        default: return "UNKNOWN";
+    }
+}
+
 void MessageCallback(GLenum source, GLenum type, GLuint id,
         GLenum severity, GLsizei /* length */, GLchar const* message,
         void const* /* user_param */) {
-    const auto* const src_str = [source]() {
-        switch (source) {
-            case GL_DEBUG_SOURCE_API: return "API";
-            case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "Window System";
-            case GL_DEBUG_SOURCE_SHADER_COMPILER: return "Shader Compiler";
-            case GL_DEBUG_SOURCE_THIRD_PARTY: return "Third Party";
-            case GL_DEBUG_SOURCE_APPLICATION: return "Application";
-            default: return "Other";
-        }
-    }();
-
-    const auto* const type_str = [type]() {
-        switch (type) {
-            case GL_DEBUG_TYPE_ERROR: return "Error";
-            case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
-                    return "Deprecated Behaviour";
-            case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "Undefined Behaviour";
-            case GL_DEBUG_TYPE_PORTABILITY: return "Portability";
-            case GL_DEBUG_TYPE_PERFORMANCE: return "Performance";
-            case GL_DEBUG_TYPE_MARKER: return "Marker";
-            default: return "Other";
-        }
-    }();
-
-    const auto* const severity_str = [severity]() {
-        switch (severity) {
-            case GL_DEBUG_SEVERITY_NOTIFICATION: return "Note";
-            case GL_DEBUG_SEVERITY_LOW: return "Low";
-            case GL_DEBUG_SEVERITY_MEDIUM: return "Medium";
-            case GL_DEBUG_SEVERITY_HIGH: return "HIGH";
-            default: return "UNKNOWN";
-        }
-    }();
-    fmt::print(FMT_STRING("{} {} {} {}: {}\n"), src_str, type_str,
-            severity_str, id, message);
+    fmt::print(FMT_STRING("{} {} {} {}: {}\n"), DebugSourceName(source),
+            DebugTypeName(type), DebugSeverityName(severity), id, message);
     if (type == GL_DEBUG_TYPE_ERROR) throw std::runtime_error("OpenGL Error");
 }
 
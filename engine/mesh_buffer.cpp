@@ -0,0 +1,127 @@
+#include "mesh_buffer.h"
+#include "log.h"
+#include "profiler.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace Greenbell {
+
+MeshBuffer::MeshBuffer(GLsizei element_size, GLsizei page_elements)
+        : element_size_{element_size}, page_elements_{page_elements} {
+    if (element_size <= 0 || page_elements <= 0) {
+        throw std::runtime_error("MeshBuffer: Invalid size");
+    }
+}
+
+MeshBuffer::Buffer MeshBuffer::create_buffer() const {
+    Buffer buffer;
+    // Dynamic storage so meshes can be uploaded with glNamedBufferSubData
+    glNamedBufferStorage(buffer.name(),
+            static_cast<GLsizeiptr>(page_elements_) * element_size_, nullptr,
+            GL_DYNAMIC_STORAGE_BIT);
+    return buffer;
+}
+
+MeshBuffer::Handle MeshBuffer::allocate(GLsizei count, const void* p_data) {
+    if (count <= 0 || count > page_elements_) {
+        Log::Write(LOG_ERROR, "MeshBuffer: %d elements won't fit a page of %d",
+                count, page_elements_);
+        throw std::runtime_error("MeshBuffer::allocate");
+    }
+    const auto size = static_cast<std::size_t>(count);
+    std::size_t page = 0;
+    auto first = RangeAllocator::NONE;
+    for (; page < pages_.size(); ++page) {
+        first = pages_[page].allocator.allocate(size);
+        if (first != RangeAllocator::NONE) break;
+    }
+    if (first == RangeAllocator::NONE) {
+        pages_.push_back(Page{create_buffer(),
+                RangeAllocator{static_cast<std::size_t>(page_elements_)}});
+        first = pages_.back().allocator.allocate(size);
+    }
+
+    Handle handle;
+    if (free_handles_.empty()) {
+        handle = static_cast<Handle>(slots_.size());
+        slots_.emplace_back();
+    } else {
+        handle = free_handles_.back();
+        free_handles_.pop_back();
+    }
+    slots_[handle] = Slot{page, first, size};
+    if (p_data) upload(handle, p_data, 0, count);
+    return handle;
+}
+
+void MeshBuffer::free(Handle handle) {
+    if (handle >= slots_.size() || !slots_[handle].count) return;
+    auto& slot = slots_[handle];
+    pages_[slot.page].allocator.free(slot.first, slot.count);
+    slot.count = 0;
+    free_handles_.push_back(handle);
+}
+
+void MeshBuffer::upload(Handle handle, const void* p_data, GLsizei first,
+        GLsizei count) const {
+    const auto& slot = slots_[handle];
+    const auto offset = static_cast<GLintptr>(slot.first) +
+            static_cast<GLintptr>(first);
+    glNamedBufferSubData(pages_[slot.page].buffer.name(),
+            offset * element_size_,
+            static_cast<GLsizeiptr>(count) * element_size_, p_data);
+}
+
+MeshBuffer::Range MeshBuffer::range(Handle handle) const noexcept {
+    if (handle >= slots_.size() || !slots_[handle].count) return {};
+    const auto& slot = slots_[handle];
+    return Range{pages_[slot.page].buffer.name(),
+            static_cast<GLsizei>(slot.first),
+            static_cast<GLsizei>(slot.count), slot.page};
+}
+
+bool MeshBuffer::defragment(float threshold) {
+    std::size_t worst = 0;
+    auto worst_value = threshold;
+    for (std::size_t i = 0; i < pages_.size(); ++i) {
+        const auto value = pages_[i].allocator.fragmentation();
+        if (value > worst_value) {
+            worst = i;
+            worst_value = value;
+        }
+    }
+    if (!(worst_value > threshold)) return false;
+    defragment_page(worst);
+    return true;
+}
+
+void MeshBuffer::defragment_page(std::size_t page) {
+    GB_PROFILE_ZONE("MeshBuffer::defragment_page");
+    std::vector<Handle> live;
+    for (Handle h = 0; h < slots_.size(); ++h) {
+        if (slots_[h].count && slots_[h].page == page) live.push_back(h);
+    }
+    std::sort(live.begin(), live.end(), [this](Handle a, Handle b) {
+        return slots_[a].first < slots_[b].first;
+    });
+
+    // Copying within one buffer isn't allowed when the ranges overlap, so
+    // pack everything into a new one. The old buffer is kept by OpenGL
+    // until draws already issued from it have finished.
+    auto& p = pages_[page];
+    auto buffer = create_buffer();
+    p.allocator.reset();
+    for (const auto h : live) {
+        auto& slot = slots_[h];
+        const auto first = p.allocator.allocate(slot.count);
+        glCopyNamedBufferSubData(p.buffer.name(), buffer.name(),
+                static_cast<GLintptr>(slot.first) * element_size_,
+                static_cast<GLintptr>(first) * element_size_,
+                static_cast<GLsizeiptr>(slot.count) * element_size_);
+        slot.first = first;
+    }
+    p.buffer = std::move(buffer);
+}
+
+} // namespace Greenbell
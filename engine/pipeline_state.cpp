@@ -0,0 +1,131 @@
+#include "pipeline_state.h"
+#include <initializer_list>
+#include <stdexcept>
+
+namespace Greenbell {
+
+bool PipelineDesc::operator==(const PipelineDesc& other) const noexcept {
+    return program == other.program && vao == other.vao &&
+            cull_face == other.cull_face &&
+            polygon_mode == other.polygon_mode &&
+            depth_test == other.depth_test &&
+            depth_write == other.depth_write &&
+            depth_func == other.depth_func && blend == other.blend &&
+            // The factors and equation don't matter while blend is off
+            (!blend || (blend_source == other.blend_source &&
+            blend_destination == other.blend_destination &&
+            blend_equation == other.blend_equation));
+}
+
+// FNV-1a over the values rather than the bytes, so padding doesn't matter
+static std::uint64_t HashValues(std::initializer_list<std::uint32_t> values)
+        noexcept {
+    std::uint64_t hash = 0xcbf29ce484222325;
+    for (const auto value : values) {
+        for (auto i = 0; i < 4; ++i) {
+            hash ^= (value >> (i * 8)) & 0xFF;
+            hash *= 0x100000001b3;
+        }
+    }
+    return hash;
+}
+
+static std::uint64_t FixedFunctionHash(const PipelineDesc& d) noexcept {
+    return HashValues({d.cull_face, d.polygon_mode, d.depth_test,
+            d.depth_write, d.depth_func, d.blend,
+            d.blend ? d.blend_source : 0u,
+            d.blend ? d.blend_destination : 0u,
+            d.blend ? d.blend_equation : 0u});
+}
+
+std::uint64_t PipelineDesc::hash() const noexcept {
+    return HashValues({program, vao}) ^ FixedFunctionHash(*this);
+}
+
+// Position of value in values, or all of the bits when it isn't there
+static std::uint64_t Index(GLenum value,
+        std::initializer_list<GLenum> values, unsigned int bits) noexcept {
+    std::uint64_t index = 0;
+    for (const auto v : values) {
+        if (v == value) return index;
+        ++index;
+    }
+    return (std::uint64_t{1} << bits) - 1;
+}
+
+static constexpr std::initializer_list<GLenum> BLEND_FACTORS{GL_ZERO, GL_ONE,
+        GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR, GL_DST_COLOR,
+        GL_ONE_MINUS_DST_COLOR, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+        GL_DST_ALPHA, GL_ONE_MINUS_DST_ALPHA, GL_CONSTANT_COLOR,
+        GL_ONE_MINUS_CONSTANT_COLOR, GL_CONSTANT_ALPHA,
+        GL_ONE_MINUS_CONSTANT_ALPHA, GL_SRC_ALPHA_SATURATE, GL_SRC1_COLOR,
+        GL_ONE_MINUS_SRC1_COLOR, GL_SRC1_ALPHA, GL_ONE_MINUS_SRC1_ALPHA};
+
+// From the top: program 16 bits, blend 14, depth 5, raster 4, unused 9,
+// VAO 16. Unused blend fields are left 0 so they can't split draws up.
+static std::uint64_t SortKey(const PipelineDesc& d) noexcept {
+    auto key = static_cast<std::uint64_t>(d.program & 0xFFFF);
+    const auto add = [&key](std::uint64_t value, unsigned int bits) {
+        key = (key << bits) | value;
+    };
+    add(d.blend, 1);
+    add(d.blend ? Index(d.blend_source, BLEND_FACTORS, 5) : 0, 5);
+    add(d.blend ? Index(d.blend_destination, BLEND_FACTORS, 5) : 0, 5);
+    add(d.blend ? Index(d.blend_equation, {GL_FUNC_ADD, GL_FUNC_SUBTRACT,
+            GL_FUNC_REVERSE_SUBTRACT, GL_MIN, GL_MAX}, 3) : 0, 3);
+    add(d.depth_test, 1);
+    add(d.depth_write, 1);
+    add(Index(d.depth_func, {GL_NEVER, GL_LESS, GL_EQUAL, GL_LEQUAL,
+            GL_GREATER, GL_NOTEQUAL, GL_GEQUAL, GL_ALWAYS}, 3), 3);
+    add(Index(d.cull_face, {GL_NONE, GL_FRONT, GL_BACK, GL_FRONT_AND_BACK},
+            2), 2);
+    add(Index(d.polygon_mode, {GL_FILL, GL_LINE, GL_POINT}, 2), 2);
+    add(0, 9);
+    add(d.vao & 0xFFFF, 16);
+    return key;
+}
+
+PipelineState::PipelineState(const PipelineDesc& desc,
+        std::uint16_t id) noexcept
+        : desc_{desc}, hash_{desc.hash()}, sort_key_{SortKey(desc)},
+        id_{id} {
+}
+
+void PipelineState::bind() const noexcept {
+    namespace State = GL::State;
+    State::UseProgram(desc_.program);
+    State::BindVertexArray(desc_.vao);
+
+    State::Enable(State::CULL_FACE, desc_.cull_face != GL_NONE);
+    if (desc_.cull_face != GL_NONE) State::CullFace(desc_.cull_face);
+    State::PolygonMode(desc_.polygon_mode);
+
+    State::Enable(State::DEPTH_TEST, desc_.depth_test);
+    // The mask applies to clears too, so set it even without the test
+    State::DepthMask(desc_.depth_write);
+    if (desc_.depth_test) State::DepthFunc(desc_.depth_func);
+
+    State::Enable(State::BLEND, desc_.blend);
+    if (desc_.blend) {
+        State::BlendFunc(desc_.blend_source, desc_.blend_destination);
+        State::BlendEquation(desc_.blend_equation);
+    }
+}
+
+const PipelineState& PipelineCache::get(const PipelineDesc& desc) {
+    const auto hash = desc.hash();
+    const auto [first, last] = by_hash_.equal_range(hash);
+    for (auto it = first; it != last; ++it) {
+        const auto& pipeline = pipelines_[it->second];
+        if (pipeline.desc() == desc) return pipeline;
+    }
+    if (pipelines_.size() == MAX_PIPELINES) {
+        throw std::runtime_error("PipelineCache: Too many pipelines");
+    }
+    const auto id = static_cast<std::uint16_t>(pipelines_.size());
+    pipelines_.push_back(PipelineState{desc, id});
+    by_hash_.emplace(hash, id);
+    return pipelines_.back();
+}
+
+} // namespace Greenbell
@@ -0,0 +1,184 @@
+#include "profiler.h"
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace Greenbell::Profiler {
+
+static constexpr std::uint64_t RING_SIZE = 1 << 16; // Zones per thread
+
+// Fields are atomic so a trace can be written while the ring is in use
+struct Event {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<std::int64_t> start{0};
+    std::atomic<std::int64_t> end{0};
+};
+
+// Only the owning thread writes. It bumps "claimed" before overwriting an
+// event and "head" after, so a reader can tell which events it copied may
+// have been changed underneath it.
+struct ThreadBuffer {
+    std::unique_ptr<Event[]> p_events{std::make_unique<Event[]>(RING_SIZE)};
+    std::atomic<std::uint64_t> claimed{0};
+    std::atomic<std::uint64_t> head{0};
+    std::uint64_t first{0}; // Oldest event since Start, under the mutex
+    std::size_t tid{0};
+    std::string name;
+};
+
+// Buffers are kept after their thread exits so its zones can still be
+// written out
+static std::mutex registry_mutex_;
+static std::vector<std::unique_ptr<ThreadBuffer>> registry_;
+static std::int64_t epoch_{0};
+
+// The buffer is only created once the thread records something, so naming
+// threads costs nothing unless profiling is used
+static thread_local ThreadBuffer* tl_buffer = nullptr;
+static thread_local std::string tl_name;
+
+static std::int64_t Nanoseconds(Clock::time_point t) noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            t.time_since_epoch()).count();
+}
+
+static ThreadBuffer& Buffer() {
+    if (!tl_buffer) {
+        std::lock_guard<std::mutex> lock{registry_mutex_};
+        registry_.push_back(std::make_unique<ThreadBuffer>());
+        tl_buffer = registry_.back().get();
+        tl_buffer->tid = registry_.size();
+        tl_buffer->name = tl_name;
+    }
+    return *tl_buffer;
+}
+
+void Start() {
+    std::lock_guard<std::mutex> lock{registry_mutex_};
+    for (auto& p_buffer : registry_) {
+        p_buffer->first = p_buffer->head.load(std::memory_order_acquire);
+    }
+    epoch_ = Nanoseconds(Clock::now());
+    enabled_.store(true);
+}
+
+void Stop() {
+    enabled_.store(false);
+}
+
+void SetThreadName(std::string name) {
+    tl_name = std::move(name);
+    if (tl_buffer) {
+        std::lock_guard<std::mutex> lock{registry_mutex_};
+        tl_buffer->name = tl_name;
+    }
+}
+
+void Record(const char* name, Clock::time_point start,
+        Clock::time_point end) noexcept {
+    if (!Enabled()) return;
+    ThreadBuffer* p_buffer = nullptr;
+    try {
+        p_buffer = &Buffer();
+    } catch (...) {
+        return; // Out of memory, lose the zone rather than the program
+    }
+    auto& b = *p_buffer;
+    const auto head = b.head.load(std::memory_order_relaxed);
+    b.claimed.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    auto& e = b.p_events[head & (RING_SIZE - 1)];
+    e.name.store(name, std::memory_order_relaxed);
+    e.start.store(Nanoseconds(start), std::memory_order_relaxed);
+    e.end.store(Nanoseconds(end), std::memory_order_relaxed);
+    b.head.store(head + 1, std::memory_order_release);
+}
+
+// Microseconds with three decimals, avoiding floating point rounding
+static void WriteTime(std::ofstream& file, std::int64_t ns) {
+    if (ns < 0) {
+        file << '-';
+        ns = -ns;
+    }
+    const auto frac = ns % 1000;
+    file << ns / 1000 << '.' << (frac < 100 ? "0" : "")
+            << (frac < 10 ? "0" : "") << frac;
+}
+
+static void WriteString(std::ofstream& file, const char* s) {
+    file << '"';
+    for (; s && *s; ++s) {
+        if (*s == '"' || *s == '\\') {
+            file << '\\' << *s;
+        } else if (static_cast<unsigned char>(*s) >= 0x20) {
+            file << *s;
+        }
+    }
+    file << '"';
+}
+
+std::size_t WriteChromeTrace(const std::string& path) {
+    std::ofstream file{path};
+    if (!file) throw std::runtime_error("Can't write profiler trace " + path);
+
+    struct Copy {
+        const char* name;
+        std::int64_t start;
+        std::int64_t end;
+    };
+    std::vector<Copy> events;
+
+    std::lock_guard<std::mutex> lock{registry_mutex_};
+    file << "{\"traceEvents\":[\n";
+    file << R"({"name":"process_name","ph":"M","pid":1,"tid":0,)"
+            << R"("args":{"name":"Greenbell"}})";
+    std::size_t count = 0;
+    for (const auto& p_buffer : registry_) {
+        auto& b = *p_buffer;
+        if (!b.name.empty()) {
+            file << ",\n" << R"({"name":"thread_name","ph":"M","pid":1,)"
+                    << "\"tid\":" << b.tid << R"(,"args":{"name":)";
+            WriteString(file, b.name.c_str());
+            file << "}}";
+        }
+
+        // Copy the thread's ring then drop anything it may have overwritten
+        // while it was being copied
+        const auto head = b.head.load(std::memory_order_acquire);
+        auto first = head > RING_SIZE ? head - RING_SIZE : 0;
+        if (first < b.first) first = b.first;
+        events.clear();
+        for (auto i = first; i < head; ++i) {
+            const auto& e = b.p_events[i & (RING_SIZE - 1)];
+            events.push_back(Copy{e.name.load(std::memory_order_relaxed),
+                    e.start.load(std::memory_order_relaxed),
+                    e.end.load(std::memory_order_relaxed)});
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const auto claimed = b.claimed.load(std::memory_order_relaxed);
+        const auto valid = claimed > RING_SIZE ? claimed - RING_SIZE : 0;
+        const auto skip = valid > first ?
+                static_cast<std::size_t>(valid - first) : 0;
+
+        for (std::size_t i = skip; i < events.size(); ++i) {
+            const auto& e = events[i];
+            file << ",\n{\"name\":";
+            WriteString(file, e.name);
+            file << R"(,"ph":"X","pid":1,"tid":)" << b.tid << ",\"ts\":";
+            WriteTime(file, e.start - epoch_);
+            file << ",\"dur\":";
+            WriteTime(file, e.end - e.start);
+            file << '}';
+            ++count;
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    if (!file) throw std::runtime_error("Can't write profiler trace " + path);
+    return count;
+}
+
+} // namespace Greenbell::Profiler
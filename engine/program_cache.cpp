@@ -0,0 +1,230 @@
+#include "program_cache.h"
+#include "log.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace Greenbell::ProgramCache {
+
+// Change when the file layout changes so old files are ignored
+static constexpr std::uint32_t VERSION = 1;
+static constexpr char MAGIC[4] = {'G', 'B', 'P', 'C'};
+// Far more than any driver's binary, so a corrupt length can't allocate
+// without limit
+static constexpr std::uint32_t MAX_BINARY = 64 << 20;
+
+struct FileHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t key;
+    std::uint32_t format;
+    std::uint32_t length;
+    std::int64_t compile_time; // Microseconds
+};
+
+static std::mutex mutex_;
+static std::string directory_;
+static Stats stats_;
+static std::uint64_t driver_hash_{0};
+static bool driver_hashed_{false};
+
+// FNV-1a
+static constexpr std::uint64_t FNV_OFFSET = 0xcbf29ce484222325;
+static constexpr std::uint64_t FNV_PRIME = 0x100000001b3;
+
+static std::uint64_t Hash(std::uint64_t hash, std::string_view s) noexcept {
+    for (const auto c : s) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= FNV_PRIME;
+    }
+    // Include the length so moving text between sources changes the key
+    for (auto n = s.size(); n; n >>= 8) {
+        hash ^= (n & 0xFF);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static std::string_view DriverString(GLenum name) {
+    const auto p = reinterpret_cast<const char*>(glGetString(name));
+    return p ? std::string_view{p} : std::string_view{};
+}
+
+static std::string FilePath(std::uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin",
+            static_cast<unsigned long long>(key));
+    return directory_ + '/' + name;
+}
+
+static std::chrono::microseconds Since(
+        std::chrono::steady_clock::time_point start) noexcept {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+}
+
+void SetDirectory(std::string path) {
+    while (path.size() > 1 && path.back() == '/') path.pop_back();
+    LogStats(); // For the directory being replaced, if any was used
+    std::lock_guard<std::mutex> lock{mutex_};
+    stats_ = Stats{};
+    directory_ = std::move(path);
+    if (directory_.empty()) {
+        Log::Write(LOG_INFO, "ProgramCache: Off");
+    } else {
+        Log::Write(LOG_INFO, "ProgramCache: Using %s", directory_);
+    }
+}
+
+bool Enabled() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return !directory_.empty();
+}
+
+std::uint64_t Key(std::initializer_list<std::string_view> sources) {
+    std::uint64_t hash;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (!driver_hashed_) {
+            driver_hash_ = FNV_OFFSET;
+            driver_hash_ = Hash(driver_hash_, DriverString(GL_VENDOR));
+            driver_hash_ = Hash(driver_hash_, DriverString(GL_RENDERER));
+            driver_hash_ = Hash(driver_hash_, DriverString(GL_VERSION));
+            driver_hashed_ = true;
+        }
+        hash = driver_hash_;
+    }
+    for (const auto source : sources) hash = Hash(hash, source);
+    return hash;
+}
+
+bool Load(GLuint pid, std::uint64_t key) {
+    const auto start = std::chrono::steady_clock::now();
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (directory_.empty()) return false;
+        path = FilePath(key);
+    }
+
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    FileHeader header{};
+    std::vector<char> binary;
+    if (file) {
+        // The binary must be exactly the rest of the file, so a truncated
+        // or corrupt file is a miss
+        const auto size = static_cast<std::uint64_t>(file.tellg());
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (file && std::equal(std::begin(MAGIC), std::end(MAGIC),
+                    header.magic) && header.version == VERSION &&
+                header.key == key && header.length > 0 &&
+                header.length <= MAX_BINARY &&
+                size == sizeof(header) + header.length) {
+            binary.resize(header.length);
+            file.read(binary.data(), static_cast<std::streamsize>(
+                    binary.size()));
+            if (!file) binary.clear();
+        }
+    }
+    if (binary.empty()) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        ++stats_.misses;
+        return false;
+    }
+
+    glProgramBinary(pid, header.format, binary.data(),
+            static_cast<GLsizei>(binary.size()));
+    GLint status = GL_FALSE;
+    glGetProgramiv(pid, GL_LINK_STATUS, &status);
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (status != GL_TRUE) {
+        Log::Write(LOG_INFO, "ProgramCache: Driver rejected %s", path);
+        ++stats_.rejected;
+        ++stats_.misses;
+        return false;
+    }
+    const auto load_time = Since(start);
+    ++stats_.hits;
+    stats_.load_time += load_time;
+    stats_.time_saved += std::chrono::microseconds(header.compile_time) -
+            load_time;
+    return true;
+}
+
+void Store(GLuint pid, std::uint64_t key,
+        std::chrono::microseconds compile_time) {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (directory_.empty()) return;
+        path = FilePath(key);
+    }
+
+    GLint length = 0;
+    glGetProgramiv(pid, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return; // No binary formats supported
+    std::vector<char> binary(static_cast<std::size_t>(length));
+    GLenum format = 0;
+    glGetProgramBinary(pid, length, &length, &format, binary.data());
+    if (length <= 0) return;
+
+    FileHeader header{};
+    std::copy(std::begin(MAGIC), std::end(MAGIC), header.magic);
+    header.version = VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = static_cast<std::uint32_t>(length);
+    header.compile_time = compile_time.count();
+
+    // Another process may be writing the same key. Whichever rename comes
+    // last wins, and both files are complete.
+    static std::mt19937_64 random{std::random_device{}()};
+    std::string temp_path;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), ".%016llx.tmp",
+                static_cast<unsigned long long>(random()));
+        temp_path = path + suffix;
+    }
+    {
+        std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+        if (!file) {
+            file.close();
+            std::remove(temp_path.c_str());
+            Log::Write(LOG_INFO, "ProgramCache: Unable to write %s",
+                    temp_path);
+            return;
+        }
+    }
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        // Windows won't rename over an existing file, but then someone
+        // else has already stored it
+        std::remove(temp_path.c_str());
+    }
+}
+
+Stats GetStats() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return stats_;
+}
+
+void LogStats() {
+    const auto stats = GetStats();
+    const auto total = stats.hits + stats.misses;
+    if (!total) return;
+    Log::Write(LOG_INFO,
+            "ProgramCache: %d of %d programs loaded (%d%%), %d rejected, "
+            "%dms saved", stats.hits, total, stats.hits * 100 / total,
+            stats.rejected, stats.time_saved.count() / 1000);
+}
+
+} // namespace Greenbell::ProgramCache
@@ -0,0 +1,41 @@
+#include "radix_sort.h"
+#include <array>
+#include <cstddef>
+#include <utility>
+
+namespace Greenbell {
+
+void RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch) {
+    static constexpr std::size_t PASSES = sizeof(std::uint64_t);
+    const auto n = items.size();
+    if (n < 2) return;
+    scratch.resize(n);
+
+    // Count every digit of every pass in one read of the keys
+    std::array<std::array<std::size_t, 256>, PASSES> counts{};
+    for (const auto& item : items) {
+        for (std::size_t pass = 0; pass < PASSES; ++pass) {
+            ++counts[pass][(item.key >> (pass * 8)) & 0xFF];
+        }
+    }
+
+    for (std::size_t pass = 0; pass < PASSES; ++pass) {
+        auto& count = counts[pass];
+        const auto shift = pass * 8;
+        // Every key has the same byte here, so the order can't change
+        if (count[(items[0].key >> shift) & 0xFF] == n) continue;
+
+        std::size_t total = 0;
+        for (auto& c : count) {
+            const auto start = total;
+            total += c;
+            c = start;
+        }
+        for (const auto& item : items) {
+            scratch[count[(item.key >> shift) & 0xFF]++] = item;
+        }
+        items.swap(scratch);
+    }
+}
+
+} // namespace Greenbell
@@ -0,0 +1,81 @@
+#include "range_allocator.h"
+#include <iterator>
+
+namespace Greenbell {
+
+RangeAllocator::RangeAllocator(std::size_t capacity)
+        : capacity_{capacity}, free_space_{0} {
+    reset();
+}
+
+void RangeAllocator::reset() {
+    by_offset_.clear();
+    by_size_.clear();
+    free_space_ = 0;
+    if (capacity_) insert(0, capacity_);
+}
+
+void RangeAllocator::insert(std::size_t offset, std::size_t size) {
+    by_offset_.emplace(offset, size);
+    by_size_.emplace(size, offset);
+    free_space_ += size;
+}
+
+void RangeAllocator::erase(std::map<std::size_t, std::size_t>::iterator it) {
+    auto [first, last] = by_size_.equal_range(it->second);
+    for (; first != last; ++first) {
+        if (first->second == it->first) {
+            by_size_.erase(first);
+            break;
+        }
+    }
+    free_space_ -= it->second;
+    by_offset_.erase(it);
+}
+
+std::size_t RangeAllocator::allocate(std::size_t size,
+        std::size_t alignment) {
+    if (!size) return NONE;
+    // Smallest range which still fits once aligned. Without alignment the
+    // first one tried always fits.
+    for (auto it = by_size_.lower_bound(size); it != by_size_.end(); ++it) {
+        const auto [range_size, range_offset] = *it;
+        const auto offset = (range_offset + alignment - 1) & ~(alignment - 1);
+        const auto padding = offset - range_offset;
+        if (padding + size > range_size) continue;
+
+        erase(by_offset_.find(range_offset));
+        if (padding) insert(range_offset, padding);
+        const auto rest = range_size - padding - size;
+        if (rest) insert(offset + size, rest);
+        return offset;
+    }
+    return NONE;
+}
+
+void RangeAllocator::free(std::size_t offset, std::size_t size) {
+    if (!size) return;
+    // Merge with the free ranges either side
+    auto next = by_offset_.lower_bound(offset);
+    if (next != by_offset_.begin()) {
+        const auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            size += prev->second;
+            erase(prev);
+        }
+    }
+    if (next != by_offset_.end() && offset + size == next->first) {
+        size += next->second;
+        erase(next);
+    }
+    insert(offset, size);
+}
+
+float RangeAllocator::fragmentation() const noexcept {
+    if (!free_space_) return 0.0f;
+    return 1.0f - static_cast<float>(largest_free()) /
+            static_cast<float>(free_space_);
+}
+
+} // namespace Greenbell
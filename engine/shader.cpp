@@ -3,17 +3,63 @@
 #include "gb_fmt.h"
 #include "gl.h"
 #include "gl_layout.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include "shader_reflection.h"
+#include "SDL2/SDL.h"
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <string_view>
 #include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <vector>
 
 namespace Greenbell::Shader {
 
-static constexpr std::string_view GLSL_VERSION = "#version 450 core\n";
+// From GL_KHR_parallel_shader_compile, which Glad wasn't generated with. The
+// ARB version uses the same values.
+static constexpr GLenum COMPLETION_STATUS_KHR = 0x91B1;
+using MaxShaderCompilerThreadsProc = void (APIENTRYP)(GLuint count);
+
+using Clock = std::chrono::steady_clock;
+
+// Try the program cache first. Returns true if the program was loaded.
+// Otherwise key is set to store the program under once it's built, or left
+// empty if the cache is off.
+static bool LoadCached(GLuint pid,
+        std::initializer_list<std::string_view> sources,
+        std::optional<std::uint64_t>& key) {
+    key.reset();
+    if (!ProgramCache::Enabled()) return false;
+    key = ProgramCache::Key(sources);
+    if (ProgramCache::Load(pid, *key)) {
+        Reflect(pid);
+        Log::Write(LOG_TRACE, "Loaded cached program for ID = %d", pid);
+        return true;
+    }
+    // Must be set before linking for glGetProgramBinary to work
+    glProgramParameteri(pid, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    return false;
+}
+
+static void StoreCached(GLuint pid, std::optional<std::uint64_t> key,
+        Clock::time_point start) {
+    if (!key) return;
+    ProgramCache::Store(pid, *key,
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - start));
+}
 
 void Build(GLuint pid, std::string_view vertex_source,
         std::string_view fragment_source) {
     static constexpr auto fail_msg = "Shader::Build";
+    GB_PROFILE_ZONE(fail_msg);
+    const auto start = Clock::now();
+    std::optional<std::uint64_t> key;
+    if (LoadCached(pid, {vertex_source, fragment_source}, key)) return;
 
     Log::Write(LOG_TRACE, "Build VS:");
     Log::Write(LOG_TRACE, vertex_source);
@@ -49,6 +95,8 @@ void Build(GLuint pid, std::string_view vertex_source,
     // Detach shaders (will delete when they go out of scope)
     vertex_shader.detach(pid);
     fragment_shader.detach(pid);
+    Reflect(pid);
+    StoreCached(pid, key, start);
 
     Log::Write(LOG_TRACE, "Build Finished for ID = %d", pid);
 }
@@ -80,6 +128,11 @@ void BuildOverlay(GLuint pid, std::string_view main) {
 
 void BuildCompute(GLuint pid, std::string_view source) {
     static constexpr auto fail_msg = "Shader::BuildCompute";
+    GB_PROFILE_ZONE(fail_msg);
+    const auto start = Clock::now();
+    std::optional<std::uint64_t> key;
+    if (LoadCached(pid, {source}, key)) return;
+
     Log::Write(LOG_TRACE, "BuildCompute:");
     Log::Write(LOG_TRACE, source);
     const GL::ComputeShader shader{};
@@ -99,6 +152,8 @@ void BuildCompute(GLuint pid, std::string_view source) {
         throw std::runtime_error(fail_msg);
     }    
     shader.detach(pid); // So it can delete when it goes out of scope
+    Reflect(pid);
+    StoreCached(pid, key, start);
     Log::Write(LOG_TRACE, "Build Finished for ID = %d", pid);
 }
 
@@ -128,4 +183,181 @@ void PrintProgramLog(GLuint pid) {
     std::cerr << error_log.data();
 }
 
+struct Future::State {
+    enum Status { PENDING, DONE, FAILED };
+
+    GLuint pid{0};
+    std::vector<GLuint> shaders;
+    std::optional<std::uint64_t> key; // Empty if the cache is off
+    Clock::time_point start;
+    Status status{PENDING};
+
+    // Check the results and free the shaders. Waits if the driver hasn't
+    // finished.
+    void finish();
+};
+
+void Future::State::finish() {
+    GLint error_check = GL_FALSE;
+    glGetProgramiv(pid, GL_LINK_STATUS, &error_check);
+    if (error_check == GL_TRUE) {
+        status = DONE;
+    } else {
+        status = FAILED;
+        bool compiled = true;
+        for (const auto shader : shaders) {
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &error_check);
+            if (error_check != GL_TRUE) {
+                Log::Write(LOG_ERROR, "Unable to compile shader for ID = %d",
+                        pid);
+                PrintShaderLog(shader);
+                compiled = false;
+            }
+        }
+        if (compiled) {
+            Log::Write(LOG_ERROR, "Unable to link shader program ID = %d",
+                    pid);
+            PrintProgramLog(pid);
+        }
+    }
+    for (const auto shader : shaders) {
+        glDetachShader(pid, shader);
+        glDeleteShader(shader);
+    }
+    shaders.clear();
+    if (status == DONE) {
+        try {
+            Reflect(pid);
+        } catch (const std::runtime_error&) {
+            status = FAILED; // Already logged
+            return;
+        }
+        StoreCached(pid, key, start);
+        Log::Write(LOG_TRACE, "Build Finished for ID = %d", pid);
+    }
+}
+
+bool Future::ready() const noexcept {
+    return p_state_ && p_state_->status != State::PENDING;
+}
+
+bool Future::failed() const noexcept {
+    return p_state_ && p_state_->status == State::FAILED;
+}
+
+void Future::get() const {
+    if (!p_state_) throw std::runtime_error("Shader::Future: No state");
+    // Batch drops finished programs next time it polls
+    if (p_state_->status == State::PENDING) p_state_->finish();
+    if (p_state_->status == State::FAILED) {
+        throw std::runtime_error("Shader::Batch");
+    }
+}
+
+bool Batch::Parallel() {
+    static const bool parallel =
+            SDL_GL_ExtensionSupported("GL_KHR_parallel_shader_compile") ||
+            SDL_GL_ExtensionSupported("GL_ARB_parallel_shader_compile");
+    return parallel;
+}
+
+Batch::Batch() {
+    // Let the driver choose how many threads to use. It may default to
+    // none.
+    static const bool threads_set = [] {
+        if (!Parallel()) return false;
+        auto p_proc = reinterpret_cast<MaxShaderCompilerThreadsProc>(
+                SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsKHR"));
+        if (!p_proc) {
+            p_proc = reinterpret_cast<MaxShaderCompilerThreadsProc>(
+                    SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsARB"));
+        }
+        if (p_proc) p_proc(0xFFFFFFFF);
+        return true;
+    }();
+    static_cast<void>(threads_set);
+}
+
+Batch::~Batch() {
+    wait();
+}
+
+Batch& Batch::operator=(Batch&& source) {
+    if (&source == this) return *this; // Self assignment
+    wait(); // Otherwise the shaders pending here would never be deleted
+    pending_ = std::move(source.pending_);
+    source.pending_.clear();
+    return *this;
+}
+
+Future Batch::add(GLuint pid, std::string_view vertex_source,
+        std::string_view fragment_source) {
+    return issue(pid, {vertex_source, fragment_source},
+            {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER});
+}
+
+Future Batch::add_compute(GLuint pid, std::string_view source) {
+    return issue(pid, {source}, {GL_COMPUTE_SHADER});
+}
+
+Future Batch::issue(GLuint pid,
+        std::initializer_list<std::string_view> sources,
+        std::initializer_list<GLenum> types) {
+    GB_PROFILE_ZONE("Shader::Batch::issue");
+    Future future;
+    future.p_state_ = std::make_shared<Future::State>();
+    auto& state = *future.p_state_;
+    state.pid = pid;
+    state.start = Clock::now();
+    if (LoadCached(pid, sources, state.key)) {
+        state.status = Future::State::DONE;
+        return future;
+    }
+
+    // Nothing here asks for a result, so none of it waits for the driver
+    auto p_type = types.begin();
+    for (const auto source : sources) {
+        const auto shader = glCreateShader(*p_type++);
+        const auto p_source = source.data();
+        const auto length = static_cast<GLint>(source.length());
+        glShaderSource(shader, 1, &p_source, &length);
+        glCompileShader(shader);
+        glAttachShader(pid, shader);
+        state.shaders.push_back(shader);
+    }
+    glLinkProgram(pid);
+    pending_.push_back(future.p_state_);
+    return future;
+}
+
+std::size_t Batch::poll() {
+    GB_PROFILE_ZONE("Shader::Batch::poll");
+    bool waited = false;
+    for (const auto& p_state : pending_) {
+        if (p_state->status != Future::State::PENDING) continue;
+        if (Parallel()) {
+            GLint complete = GL_FALSE;
+            glGetProgramiv(p_state->pid, COMPLETION_STATUS_KHR, &complete);
+            if (complete != GL_TRUE) continue;
+        } else if (waited) {
+            break;
+        }
+        p_state->finish();
+        waited = true;
+    }
+    pending_.erase(std::remove_if(pending_.begin(), pending_.end(),
+            [](const auto& p_state) {
+                return p_state->status != Future::State::PENDING;
+            }), pending_.end());
+    return pending_.size();
+}
+
+void Batch::wait() {
+    GB_PROFILE_ZONE("Shader::Batch::wait");
+    for (const auto& p_state : pending_) {
+        if (p_state->status == Future::State::PENDING) p_state->finish();
+    }
+    pending_.clear();
+}
+
 } // namespace Greenbell::Shader
@@ -0,0 +1,200 @@
+#include "shader_reflection.h"
+#include "log.h"
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace Greenbell::Shader {
+
+struct ExpectedBlock {
+    std::size_t size;
+    std::vector<std::pair<std::string, std::size_t>> members;
+};
+
+static std::mutex mutex_;
+static std::unordered_map<GLuint, std::shared_ptr<const Reflection>>
+        reflections_;
+static std::unordered_map<GLint, ExpectedBlock> expected_;
+
+static std::string ResourceName(GLuint pid, GLenum interface, GLuint index,
+        GLint length) {
+    std::string name(static_cast<std::size_t>(length), '\0');
+    GLsizei written = 0;
+    glGetProgramResourceName(pid, interface, index, length, &written,
+            name.data());
+    name.resize(static_cast<std::size_t>(written));
+    // Arrays are listed by their first element
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+        name.resize(name.size() - 3);
+    }
+    return name;
+}
+
+// Members of a block with an instance name are reported as "Block.member"
+static bool MemberNameMatches(std::string_view reported,
+        std::string_view expected) noexcept {
+    if (reported == expected) return true;
+    return reported.size() > expected.size() &&
+            reported.substr(reported.size() - expected.size()) == expected &&
+            reported[reported.size() - expected.size() - 1] == '.';
+}
+
+Reflection::Reflection(GLuint pid) {
+    GLint count = 0;
+    glGetProgramInterfaceiv(pid, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES,
+            &count);
+    blocks_.reserve(static_cast<std::size_t>(count));
+    for (GLuint i = 0; i < static_cast<GLuint>(count); ++i) {
+        static constexpr GLenum props[] = {
+            GL_NAME_LENGTH, GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE};
+        static constexpr auto n = static_cast<GLsizei>(std::size(props));
+        GLint values[n];
+        glGetProgramResourceiv(pid, GL_UNIFORM_BLOCK, i, n, props, n,
+                nullptr, values);
+        auto name = ResourceName(pid, GL_UNIFORM_BLOCK, i, values[0]);
+        const auto hash = NameHash(name);
+        blocks_.push_back(BlockInfo{std::move(name), hash, i, values[1],
+                values[2]});
+    }
+
+    glGetProgramInterfaceiv(pid, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+    uniforms_.reserve(static_cast<std::size_t>(count));
+    for (GLuint i = 0; i < static_cast<GLuint>(count); ++i) {
+        static constexpr GLenum props[] = {
+            GL_NAME_LENGTH, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE,
+            GL_BLOCK_INDEX, GL_OFFSET, GL_ARRAY_STRIDE, GL_MATRIX_STRIDE};
+        static constexpr auto n = static_cast<GLsizei>(std::size(props));
+        GLint values[n];
+        glGetProgramResourceiv(pid, GL_UNIFORM, i, n, props, n, nullptr,
+                values);
+        auto name = ResourceName(pid, GL_UNIFORM, i, values[0]);
+        const auto hash = NameHash(name);
+        uniforms_.push_back(UniformInfo{std::move(name), hash,
+                static_cast<GLenum>(values[1]), values[2], values[3],
+                values[4], values[5], values[6], values[7]});
+    }
+
+    uniform_slots_ = MakeTable(uniforms_);
+    block_slots_ = MakeTable(blocks_);
+}
+
+template <typename T>
+std::vector<Reflection::Slot> Reflection::MakeTable(
+        const std::vector<T>& entries) {
+    // At most half full so probes stay short
+    std::size_t size = 4;
+    while (size < entries.size() * 2) size *= 2;
+    std::vector<Slot> table(size, Slot{0, 0});
+    const auto mask = size - 1;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        const auto hash = entries[i].hash;
+        auto pos = hash & mask;
+        while (table[pos].index) {
+            if (table[pos].hash == hash) {
+                Log::Write(LOG_ERROR, "Shader: %s and %s have the same hash",
+                        entries[table[pos].index - 1].name, entries[i].name);
+            }
+            pos = (pos + 1) & mask;
+        }
+        table[pos] = Slot{hash, static_cast<std::uint32_t>(i + 1)};
+    }
+    return table;
+}
+
+const Reflection::Slot* Reflection::Find(const std::vector<Slot>& table,
+        std::uint32_t hash) noexcept {
+    if (table.empty()) return nullptr;
+    const auto mask = table.size() - 1;
+    for (auto pos = hash & mask; table[pos].index; pos = (pos + 1) & mask) {
+        if (table[pos].hash == hash) return &table[pos];
+    }
+    return nullptr;
+}
+
+const UniformInfo* Reflection::uniform(std::uint32_t hash) const noexcept {
+    const auto p_slot = Find(uniform_slots_, hash);
+    return p_slot ? &uniforms_[p_slot->index - 1] : nullptr;
+}
+
+const BlockInfo* Reflection::block(std::uint32_t hash) const noexcept {
+    const auto p_slot = Find(block_slots_, hash);
+    return p_slot ? &blocks_[p_slot->index - 1] : nullptr;
+}
+
+// Log every difference before giving up, so they can all be fixed at once
+static bool CheckBlock(GLuint pid, const Reflection& reflection,
+        GLint block_index, const ExpectedBlock& expected) {
+    const auto& block = reflection.blocks()[
+            static_cast<std::size_t>(block_index)];
+    bool ok = true;
+    if (static_cast<std::size_t>(block.size) > expected.size) {
+        Log::Write(LOG_ERROR, "Shader %d: Block %s is %d bytes but the "
+                "struct is %d", pid, block.name, block.size, expected.size);
+        ok = false;
+    }
+    // Struct members missing from the shader are fine, since unused
+    // members can be optimised out
+    for (const auto& uniform : reflection.uniforms()) {
+        if (uniform.block != block_index) continue;
+        bool matched = false;
+        for (const auto& [name, offset] : expected.members) {
+            if (!MemberNameMatches(uniform.name, name)) continue;
+            matched = true;
+            if (static_cast<std::size_t>(uniform.offset) != offset) {
+                Log::Write(LOG_ERROR, "Shader %d: %s is at offset %d but "
+                        "the struct has it at %d", pid, uniform.name,
+                        uniform.offset, offset);
+                ok = false;
+            }
+            break;
+        }
+        if (!matched) {
+            Log::Write(LOG_ERROR, "Shader %d: %s is not in the struct for "
+                    "binding %d", pid, uniform.name, block.binding);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void Reflect(GLuint pid) {
+    auto p_reflection = std::make_shared<const Reflection>(pid);
+    std::lock_guard<std::mutex> lock{mutex_};
+    bool ok = true;
+    for (std::size_t i = 0; i < p_reflection->blocks().size(); ++i) {
+        const auto it = expected_.find(p_reflection->blocks()[i].binding);
+        if (it == expected_.end()) continue;
+        if (!CheckBlock(pid, *p_reflection, static_cast<GLint>(i),
+                    it->second)) {
+            ok = false;
+        }
+    }
+    reflections_[pid] = std::move(p_reflection);
+    if (!ok) throw std::runtime_error("Shader: Uniform block mismatch");
+}
+
+std::shared_ptr<const Reflection> GetReflection(GLuint pid) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    const auto it = reflections_.find(pid);
+    return (it == reflections_.end()) ? nullptr : it->second;
+}
+
+void ForgetReflection(GLuint pid) noexcept {
+    std::lock_guard<std::mutex> lock{mutex_};
+    reflections_.erase(pid);
+}
+
+void ExpectBlock(GLint binding, std::size_t size,
+        std::initializer_list<BlockMember> members) {
+    ExpectedBlock expected{size, {}};
+    for (const auto& member : members) {
+        expected.members.emplace_back(std::string{member.name},
+                member.offset);
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    expected_[binding] = std::move(expected);
+}
+
+} // namespace Greenbell::Shader
@@ -0,0 +1,121 @@
+#include "shader_variants.h"
+#include "log.h"
+#include "profiler.h"
+#include <stdexcept>
+#include <utility>
+
+namespace Greenbell {
+
+static std::vector<std::string> FeatureList(
+        std::initializer_list<std::string_view> features) {
+    if (features.size() > MAX_VARIANT_FEATURES) {
+        throw std::runtime_error("ShaderVariants: Too many features");
+    }
+    return {features.begin(), features.end()};
+}
+
+ShaderVariants::ShaderVariants(std::string vertex_source,
+        std::string fragment_source,
+        std::initializer_list<std::string_view> features)
+        : sources_{std::move(vertex_source), std::move(fragment_source)},
+        features_{FeatureList(features)} {
+}
+
+ShaderVariants::ShaderVariants(std::string compute_source,
+        std::initializer_list<std::string_view> features)
+        : sources_{std::move(compute_source)},
+        features_{FeatureList(features)} {
+}
+
+std::string ShaderVariants::defines(VariantKey key) const {
+    if (features_.size() < MAX_VARIANT_FEATURES &&
+            (key >> features_.size())) {
+        throw std::runtime_error("ShaderVariants: Unknown feature in key");
+    }
+    std::string ret;
+    for (std::size_t i = 0; i < features_.size(); ++i) {
+        if (key & VariantBit(i)) {
+            ret += "#define ";
+            ret += features_[i];
+            ret += " 1\n";
+        }
+    }
+    return ret;
+}
+
+std::string ShaderVariants::source(std::size_t index, VariantKey key) const {
+    std::string ret{Shader::GLSL_VERSION};
+    ret += defines(key);
+    ret += sources_[index];
+    return ret;
+}
+
+ShaderVariants::Variant& ShaderVariants::start(VariantKey key) {
+    // Generate the sources first so a bad key throws before adding anything
+    const auto first = source(0, key);
+    auto& variant = programs_[key];
+    if (sources_.size() == 1) {
+        variant.future = batch_.add_compute(variant.program.name(), first);
+    } else {
+        variant.future = batch_.add(variant.program.name(), first,
+                source(1, key));
+    }
+    return variant;
+}
+
+const GL::ProgramObject& ShaderVariants::get(VariantKey key) {
+    const auto it = programs_.find(key);
+    if (it != programs_.end()) {
+        const auto& variant = it->second;
+        if (variant.future.valid()) { // Prewarmed
+            try {
+                variant.future.get();
+            } catch (...) {
+                // Forgotten like a failed build on first use, so the next
+                // get or prewarm tries again
+                programs_.erase(it);
+                throw;
+            }
+        }
+        return variant.program;
+    }
+
+    GB_PROFILE_ZONE("ShaderVariants::get build");
+    Log::Write(LOG_TRACE, "ShaderVariants: Building %d on first use", key);
+    const auto first = source(0, key);
+    GL::ProgramObject program{};
+    if (sources_.size() == 1) {
+        Shader::BuildCompute(program.name(), first);
+    } else {
+        Shader::Build(program.name(), first, source(1, key));
+    }
+    // Only kept once it has built, so a failed build can be retried
+    return programs_.emplace(key, Variant{std::move(program), {}})
+            .first->second.program;
+}
+
+bool ShaderVariants::ready(VariantKey key) const {
+    const auto it = programs_.find(key);
+    if (it == programs_.end()) return false;
+    const auto& future = it->second.future;
+    return !future.valid() || future.ready();
+}
+
+void ShaderVariants::prewarm(std::initializer_list<VariantKey> keys) {
+    for (const auto key : keys) prewarm_one(key);
+}
+
+void ShaderVariants::prewarm(const std::vector<VariantKey>& keys) {
+    for (const auto key : keys) prewarm_one(key);
+}
+
+void ShaderVariants::prewarm_one(VariantKey key) {
+    const auto it = programs_.find(key);
+    if (it != programs_.end()) {
+        if (!it->second.future.failed()) return; // Built or building
+        programs_.erase(it); // Failed, so try again
+    }
+    start(key);
+}
+
+} // namespace Greenbell
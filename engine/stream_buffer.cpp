@@ -0,0 +1,84 @@
+#include "stream_buffer.h"
+#include "log.h"
+#include "profiler.h"
+#include <stdexcept>
+
+namespace Greenbell {
+
+static constexpr GLbitfield MAP_FLAGS =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+// Nanoseconds per glClientWaitSync while waiting for a region
+static constexpr GLuint64 WAIT_TIMEOUT = 1000000;
+
+StreamBuffer::StreamBuffer(GLsizeiptr region_size, std::size_t regions)
+        : region_size_{region_size}, fences_(regions ? regions : 1, nullptr) {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment > 0) uniform_alignment_ = alignment;
+    // Keep every region start aligned for any use
+    region_size_ = (region_size_ + uniform_alignment_ - 1) &
+            ~(uniform_alignment_ - 1);
+
+    const auto size = region_size_ * static_cast<GLsizeiptr>(fences_.size());
+    glNamedBufferStorage(buffer_.name(), size, nullptr, MAP_FLAGS);
+    p_mapping_ = static_cast<std::byte*>(glMapNamedBufferRange(
+            buffer_.name(), 0, size, MAP_FLAGS));
+    if (!p_mapping_) {
+        Log::Write(LOG_ERROR, "StreamBuffer: Unable to map %d bytes", size);
+        throw std::runtime_error("StreamBuffer");
+    }
+    head_ = region_start();
+}
+
+StreamBuffer::~StreamBuffer() {
+    for (const auto fence : fences_) {
+        if (fence) glDeleteSync(fence);
+    }
+    // Deleting the buffer unmaps it
+}
+
+void StreamBuffer::begin_frame() {
+    region_ = (region_ + 1) % fences_.size();
+    head_ = region_start();
+    auto& fence = fences_[region_];
+    if (!fence) return;
+
+    // Usually the GPU is long past the fence so the first check succeeds
+    auto result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        GB_PROFILE_ZONE("StreamBuffer wait");
+        const auto start = std::chrono::steady_clock::now();
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                    WAIT_TIMEOUT);
+        } while (result == GL_TIMEOUT_EXPIRED);
+        ++stalls_;
+        stall_time_ += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start);
+    }
+    if (result == GL_WAIT_FAILED) {
+        Log::Write(LOG_ERROR, "StreamBuffer: glClientWaitSync failed");
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void StreamBuffer::end_frame() {
+    auto& fence = fences_[region_];
+    if (fence) glDeleteSync(fence); // Only if begin_frame was skipped
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+StreamBuffer::Allocation StreamBuffer::allocate(GLsizeiptr size,
+        GLsizeiptr alignment) noexcept {
+    const auto offset = (head_ + alignment - 1) & ~(alignment - 1);
+    if (offset + size > region_start() + region_size_) {
+        ++overflows_;
+        return {};
+    }
+    head_ = offset + size;
+    return Allocation{p_mapping_ + offset, offset, size};
+}
+
+} // namespace Greenbell
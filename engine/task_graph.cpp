@@ -0,0 +1,129 @@
+#include "task_graph.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace Greenbell {
+
+void TaskGraph::precede(TaskId before, TaskId after) {
+    if (before >= tasks_.size() || after >= tasks_.size()) {
+        throw std::runtime_error("TaskGraph::precede unknown task");
+    }
+    edges_.emplace_back(before, after);
+    compiled_ = false;
+}
+
+void TaskGraph::compile() {
+    const auto count = tasks_.size();
+
+    // Successor lists as one flat array, bucketed by the first task of
+    // each edge
+    successor_begin_.assign(count + 1, 0);
+    predecessor_count_.assign(count, 0);
+    for (const auto& [before, after] : edges_) {
+        ++successor_begin_[before + 1];
+        ++predecessor_count_[after];
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        successor_begin_[i + 1] += successor_begin_[i];
+    }
+    successors_.resize(edges_.size());
+    std::vector<std::size_t> fill{successor_begin_.begin(),
+            successor_begin_.end() - 1};
+    for (const auto& [before, after] : edges_) {
+        successors_[fill[before]++] = after;
+    }
+
+    // Topological order, which also finds any cycle
+    order_.clear();
+    order_.reserve(count);
+    std::vector<std::size_t> waiting{predecessor_count_};
+    for (TaskId id = 0; id < count; ++id) {
+        if (!waiting[id]) order_.push_back(id);
+    }
+    for (std::size_t i = 0; i < order_.size(); ++i) {
+        const auto id = order_[i];
+        for (auto s = successor_begin_[id]; s < successor_begin_[id + 1]; ++s) {
+            if (!--waiting[successors_[s]]) order_.push_back(successors_[s]);
+        }
+    }
+    if (order_.size() != count) {
+        throw std::runtime_error("TaskGraph has a dependency cycle");
+    }
+
+    remaining_ = std::make_unique<std::atomic<std::size_t>[]>(count);
+    path_length_.assign(count, Duration{0});
+    path_previous_.assign(count, 0);
+    critical_tasks_.clear();
+    critical_tasks_.reserve(count);
+    compiled_ = true;
+}
+
+void TaskGraph::run(ThreadPool& pool, JobPriority priority) {
+    if (!compiled_) compile();
+    p_pool_ = &pool;
+    run_start_ = std::chrono::steady_clock::now();
+
+    for (TaskId id = 0; id < tasks_.size(); ++id) {
+        remaining_[id].store(predecessor_count_[id], std::memory_order_relaxed);
+    }
+    for (TaskId id = 0; id < tasks_.size(); ++id) {
+        if (!predecessor_count_[id]) {
+            pool.dispatch(priority, group_, [this, id]() { run_task(id); });
+        }
+    }
+    pool.wait(group_);
+
+    run_end_ = std::chrono::steady_clock::now();
+    find_critical_path();
+}
+
+void TaskGraph::run_task(TaskId id) {
+    auto& task = tasks_[id];
+    task.start = std::chrono::steady_clock::now();
+    task.job();
+    task.end = std::chrono::steady_clock::now();
+
+    // The last predecessor to finish dispatches the successor. Dispatching
+    // locally keeps chains of tasks on the same worker where possible.
+    for (auto s = successor_begin_[id]; s < successor_begin_[id + 1]; ++s) {
+        const auto next = successors_[s];
+        if (remaining_[next].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            p_pool_->dispatch_local(group_, [this, next]() { run_task(next); });
+        }
+    }
+}
+
+void TaskGraph::find_critical_path() {
+    // Longest path through the graph weighted by task duration, in
+    // topological order so every predecessor is done before its successors
+    std::fill(path_length_.begin(), path_length_.end(), Duration{0});
+    for (TaskId id = 0; id < tasks_.size(); ++id) path_previous_[id] = id;
+
+    critical_length_ = Duration{0};
+    auto last = tasks_.size();
+    for (const auto id : order_) {
+        path_length_[id] += duration(id);
+        if (path_length_[id] >= critical_length_) {
+            critical_length_ = path_length_[id];
+            last = id;
+        }
+        for (auto s = successor_begin_[id]; s < successor_begin_[id + 1]; ++s) {
+            const auto next = successors_[s];
+            if (path_length_[id] > path_length_[next]) {
+                path_length_[next] = path_length_[id];
+                path_previous_[next] = id;
+            }
+        }
+    }
+
+    // Walk back from the end of the path then put it in order
+    critical_tasks_.clear();
+    if (last == tasks_.size()) return;
+    for (auto id = last;; id = path_previous_[id]) {
+        critical_tasks_.push_back(id);
+        if (path_previous_[id] == id) break;
+    }
+    std::reverse(critical_tasks_.begin(), critical_tasks_.end());
+}
+
+} // namespace Greenbell
@@ -1,20 +1,60 @@
 #include "thread_pool.h"
 #include "log.h"
+#include "profiler.h"
 #include "cmake_config.h" /* DEBUG_WRAPPERS */
+#include <string>
 
 // DEBUG_WRAPPERS messages use std::count instead of fmt::print since fmt
 // might throw exceptions
 
 namespace Greenbell {
 
-ThreadPool::ThreadPool(std::size_t thread_count) : threads_{thread_count} {
+// Set for each worker thread so dispatch_local can find the worker's deque
+static thread_local const ThreadPool* tl_pool = nullptr;
+static thread_local std::size_t tl_index = 0;
+
+static constexpr auto NORMAL_LANE = static_cast<std::size_t>(JobPriority::NORMAL);
+static constexpr auto BACKGROUND_LANE =
+        static_cast<std::size_t>(JobPriority::BACKGROUND);
+
+// Lane of the job the thread is running, which dispatch_local passes on to
+// any jobs it creates. Also how many jobs the thread has taken ahead of
+// waiting background jobs.
+static thread_local std::size_t tl_lane = NORMAL_LANE;
+static thread_local int tl_background_skipped = 0;
+
+// Hint to the CPU that this is a spin loop
+static inline void CpuRelax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+ThreadPool::ThreadPool(std::size_t thread_count, PoolQueue queue) {
     #ifdef DEBUG_WRAPPERS
     std::cout << "ThreadPool ctor\n";
     #endif
 
+    // Round robin dispatch needs at least one worker
+    if (thread_count == 0) thread_count = 1;
+
     Log::Write(LOG_TRACE, "Creating thread pool of %d threads\n", thread_count);
-    for (auto& t : threads_) {
-        t = std::thread(&ThreadPool::thread_handler, this);
+    if (queue == PoolQueue::MPMC_RING) {
+        for (auto& p_ring : p_rings_) {
+            p_ring = std::make_unique<MPMCRing<job_t>>(RING_CAPACITY);
+        }
+    }
+    workers_.reserve(thread_count);
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+
+    // Threads steal from each other so only start them once every worker
+    // exists
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        workers_[i]->thread = std::thread(&ThreadPool::thread_handler, this, i);
     }
 }
 
@@ -25,59 +65,244 @@ ThreadPool::~ThreadPool() {
 
     // Lock mutex, set quit flags, notify threads
     {
-        std::lock_guard<std::mutex> lock{mutex_};
+        std::lock_guard<std::mutex> lock{sleep_mutex_};
         quit_ = true;
         cv_.notify_all();
     }
 
     // Wait for each thread to finish
-    for (auto& t : threads_) {
-        if (t.joinable()) {
-            t.join();
+    for (auto& w : workers_) {
+        if (w->thread.joinable()) {
+            w->thread.join();
         }
     }
 }
 
-void ThreadPool::dispatch(const job_t& op) {
+void ThreadPool::dispatch(JobPriority priority, job_t&& op) {
     #ifdef DEBUG_WRAPPERS
-    std::cout << "ThreadPool dispatch copy version\n";
+    std::cout << "ThreadPool dispatch\n";
     #endif
 
-    std::lock_guard<std::mutex> lock{mutex_};
-    q_.push(op);
-    cv_.notify_one();
+    const auto index = next_worker_.fetch_add(1, std::memory_order_relaxed);
+    push(index % workers_.size(), static_cast<std::size_t>(priority),
+            std::move(op), false);
 }
 
-void ThreadPool::dispatch(job_t&& op) {
-    #ifdef DEBUG_WRAPPERS
-    std::cout << "ThreadPool dispatch move version\n";
-    #endif
+void ThreadPool::dispatch_local(job_t&& op) {
+    if (tl_pool != this) {
+        dispatch(static_cast<JobPriority>(tl_lane), std::move(op));
+        return;
+    }
+    push(tl_index, tl_lane, std::move(op), true);
+}
 
-    std::lock_guard<std::mutex> lock{mutex_};
-    q_.push(std::move(op));
-    cv_.notify_one();
+void ThreadPool::push(std::size_t index, std::size_t lane, job_t&& op,
+        bool local) {
+    // Counted before it is visible to workers so wait_idle never sees zero
+    // while a job that was dispatched from another job is in flight
+    outstanding_.fetch_add(1);
+    if (p_rings_[lane]) {
+        // Rather than block on a full ring run something from it
+        while (!p_rings_[lane]->try_push(op)) {
+            job_t other;
+            std::size_t other_lane = 0;
+            if (take(worker_index(), other, other_lane)) {
+                execute(other, other_lane);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    } else {
+        // The owner takes jobs from the back so its own jobs run newest
+        // first. Jobs from outside go in the front so the owner still runs
+        // those in the order they were dispatched.
+        auto& w = *workers_[index];
+        std::lock_guard<std::mutex> lock{w.mutex};
+        if (local) {
+            w.jobs[lane].push_back(std::move(op));
+        } else {
+            w.jobs[lane].push_front(std::move(op));
+        }
+    }
+    pending_[lane].fetch_add(1);
+    wake_one();
 }
 
-void ThreadPool::thread_handler() {
-    std::unique_lock<std::mutex> lock{mutex_};
-    while(!quit_) {
-        // Wait checks the predicate first so won't wait if there are jobs in
-        // the queue or the quit flag is set. Mutex must be locked before
-        // calling wait. Wait will unlock while waiting and relock on wakeup.
-        cv_.wait(lock, [this](){
-            return (!q_.empty() || quit_); // If false will continue waiting
-        });
+void ThreadPool::wake_one() {
+    // Workers increment sleepers_ before checking pending_ and we increment
+    // pending_ before checking sleepers_, so at least one side sees the
+    // other. Only take the mutex when someone may actually be asleep.
+    if (sleepers_.load() > 0) {
+        std::lock_guard<std::mutex> lock{sleep_mutex_};
+        cv_.notify_one();
+    }
+}
+
+bool ThreadPool::runnable() const noexcept {
+    for (std::size_t lane = 0; lane < BACKGROUND_LANE; ++lane) {
+        if (pending_[lane].load() > 0) return true;
+    }
+    const auto limit = background_limit_.load();
+    return pending_[BACKGROUND_LANE].load() > 0 &&
+            (!limit || background_running_.load() < limit);
+}
+
+bool ThreadPool::pop(std::size_t index, std::size_t lane, job_t& op) {
+    auto& w = *workers_[index];
+    std::lock_guard<std::mutex> lock{w.mutex};
+    if (w.jobs[lane].empty()) return false;
+    op = w.jobs[lane].pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(std::size_t first, std::size_t count, std::size_t lane,
+        job_t& op) {
+    // Don't wait on a busy sibling, just move on to the next one. If a job
+    // was missed pending_ is still non zero so the caller will come back.
+    const auto size = workers_.size();
+    for (std::size_t i = 0; i < count; ++i) {
+        auto& w = *workers_[(first + i) % size];
+        std::unique_lock<std::mutex> lock{w.mutex, std::try_to_lock};
+        if (lock.owns_lock() && !w.jobs[lane].empty()) {
+            op = w.jobs[lane].pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::take(std::size_t index, std::size_t lane, job_t& op) {
+    if (pending_[lane].load(std::memory_order_relaxed) <= 0) return false;
+    if (p_rings_[lane]) return p_rings_[lane]->try_pop(op);
+    if (index == NOT_A_WORKER) {
+        // Not one of our workers so every deque belongs to someone else
+        const auto first = next_worker_.load(std::memory_order_relaxed);
+        return steal(first, workers_.size(), lane, op);
+    }
+    return pop(index, lane, op) ||
+            steal(index + 1, workers_.size() - 1, lane, op);
+}
+
+bool ThreadPool::take(std::size_t index, job_t& op, std::size_t& lane) {
+    // Reserve a background slot before taking a background job so the limit
+    // is never exceeded, and give it back if there was nothing to take
+    const auto take_background = [this, index, &op]() {
+        const auto limit = background_limit_.load(std::memory_order_relaxed);
+        auto running = background_running_.load();
+        do {
+            if (limit && running >= limit) return false;
+        } while (!background_running_.compare_exchange_weak(running,
+                running + 1));
+        if (take(index, BACKGROUND_LANE, op)) {
+            tl_background_skipped = 0;
+            return true;
+        }
+        background_running_.fetch_sub(1);
+        return false;
+    };
 
-        // Mutex is now locked
-        if (!q_.empty() && !quit_) {
-            // Grab a job from the queue and run it
-            auto job_function = std::move(q_.front());
-            q_.pop();
-            lock.unlock(); // Mutex should be unlocked while running job...
-            job_function();
-            lock.lock(); // ...but must be relocked for next wait
+    const auto background_waiting =
+            pending_[BACKGROUND_LANE].load(std::memory_order_relaxed) > 0;
+    if (background_waiting &&
+            tl_background_skipped >= BACKGROUND_STARVE_LIMIT &&
+            take_background()) {
+        lane = BACKGROUND_LANE;
+        return true;
+    }
+    for (lane = 0; lane < BACKGROUND_LANE; ++lane) {
+        if (take(index, lane, op)) {
+            if (background_waiting) ++tl_background_skipped;
+            return true;
         }
     }
+    return take_background();
+}
+
+void ThreadPool::execute(job_t& op, std::size_t lane) {
+    pending_[lane].fetch_sub(1);
+    const auto previous_lane = tl_lane; // Jobs may run inside a wait
+    tl_lane = lane;
+    {
+        GB_PROFILE_ZONE("Job");
+        op();
+    }
+    op.reset(); // Release any captures now
+    tl_lane = previous_lane;
+    if (lane == BACKGROUND_LANE) {
+        // A worker may be asleep because the background limit was reached
+        background_running_.fetch_sub(1);
+        if (pending_[BACKGROUND_LANE].load() > 0) wake_one();
+    }
+    outstanding_.fetch_sub(1);
+}
+
+bool ThreadPool::run_pending() {
+    job_t job_function;
+    std::size_t lane = 0;
+    if (!take(worker_index(), job_function, lane)) return false;
+    execute(job_function, lane);
+    return true;
+}
+
+std::size_t ThreadPool::worker_index() const noexcept {
+    return (tl_pool == this) ? tl_index : NOT_A_WORKER;
+}
+
+int ThreadPool::range_depth() const noexcept {
+    // Enough halvings for about four chunks per worker
+    auto depth = 0;
+    for (std::size_t chunks = 1; chunks < workers_.size() * 4; chunks <<= 1) {
+        ++depth;
+    }
+    return depth;
+}
+
+void ThreadPool::wait(const JobGroup& group) {
+    while (!group.finished()) {
+        if (!run_pending()) std::this_thread::yield();
+    }
+}
+
+void ThreadPool::wait_idle() {
+    while (outstanding_.load() > 0) {
+        if (!run_pending()) std::this_thread::yield();
+    }
+}
+
+void ThreadPool::thread_handler(std::size_t index) {
+    tl_pool = this;
+    tl_index = index;
+    GB_PROFILE_THREAD("Worker " + std::to_string(index));
+
+    // Spinning only pays off with the lock free ring. With work stealing it
+    // would just add contention on the other workers' mutexes.
+    const auto spin_limit = p_rings_[0] ? RING_SPIN_LIMIT : 0;
+    auto spins = 0;
+
+    job_t job_function;
+    std::size_t lane = 0;
+    while (!quit_) {
+        if (take(index, job_function, lane)) {
+            execute(job_function, lane);
+            spins = 0;
+            continue;
+        }
+        if (spins < spin_limit) {
+            ++spins;
+            CpuRelax();
+            continue;
+        }
+        spins = 0;
+
+        // Nothing to run so sleep until a job is dispatched. Wait checks the
+        // predicate first so won't wait if a job arrived in the meantime.
+        std::unique_lock<std::mutex> lock{sleep_mutex_};
+        sleepers_.fetch_add(1);
+        cv_.wait(lock, [this]() {
+            return (runnable() || quit_); // If false keep waiting
+        });
+        sleepers_.fetch_sub(1);
+    }
 }
 
 } // namespace Greenbell
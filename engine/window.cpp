@@ -3,10 +3,24 @@
 #include "SDL2/SDL.h"
 #include "SDL2/SDL_ttf.h"
 #include "log.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
 #include <thread>
 
 namespace Greenbell {
 
+// Once a frame on the thread which owns the context
+static void RecordStateCounters(FrameStats& frame_stats) noexcept {
+    const auto counters = GL::State::TakeCounters();
+    frame_stats.record(FrameCounter::STATE_SUBMITTED, counters.submitted);
+    frame_stats.record(FrameCounter::STATE_SKIPPED, counters.skipped);
+}
+
 // Manage init/deinit of SDL window
 class SDLWindowWrapper {
   public:
@@ -76,11 +90,168 @@ class SDLWindowWrapper {
         if (p_sdl_window_) SDL_GL_SwapWindow(p_sdl_window_);
     }
 
+    // The context can only be current on one thread at a time
+    bool make_current(bool current) const noexcept {
+        // This thread's GL::State shadow may be from before the context
+        // was last elsewhere
+        if (current) GL::State::Invalidate();
+        return SDL_GL_MakeCurrent(p_sdl_window_,
+                current ? ogl_context_ : nullptr) == 0;
+    }
+
   private:
     SDL_Window* p_sdl_window_{nullptr};
     SDL_GLContext ogl_context_{nullptr}; // Actually a void* in SDL
 };
 
+// Thread which owns the OpenGL context, replays the command buffers handed
+// over by Window::end_frame and swaps
+class RenderThread {
+  public:
+    RenderThread(SDLWindowWrapper& win, FrameStats& frame_stats)
+            : win_{win}, frame_stats_{frame_stats} {
+        win_.make_current(false);
+        thread_ = std::thread(&RenderThread::thread_handler, this);
+    }
+
+    ~RenderThread() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            quit_ = true;
+            cv_.notify_all();
+        }
+        if (thread_.joinable()) thread_.join();
+        win_.make_current(true); // Back to the main thread for cleanup
+    }
+
+    // No copy or move
+    RenderThread(const RenderThread&) = delete;
+    RenderThread& operator=(const RenderThread&) = delete;
+    RenderThread(RenderThread&&) = delete;
+    RenderThread& operator=(RenderThread&&) = delete;
+
+    // Hand over a frame and wait for the render thread to take it. It only
+    // takes a frame after it has finished the one before, so once this
+    // returns the other buffer is free to record into.
+    void submit(CommandBuffer& buffer) noexcept {
+        const auto start = Clock::now();
+        std::unique_lock<std::mutex> lock{mutex_};
+        p_frame_ = &buffer;
+        submitted_ = start;
+        cv_.notify_all();
+        cv_.wait(lock, [this]() { return p_frame_ == nullptr; });
+        main_wait_ = ToMicroseconds(Clock::now() - start);
+    }
+
+    void run_sync(Job& job) {
+        std::lock_guard<std::mutex> sync_lock{sync_mutex_}; // One at a time
+        std::unique_lock<std::mutex> lock{mutex_};
+        p_sync_ = &job;
+        cv_.notify_all();
+        cv_.wait(lock, [this]() { return p_sync_ == nullptr; });
+        if (sync_error_) std::rethrow_exception(std::exchange(sync_error_, {}));
+    }
+
+    RenderThreadStats stats() const noexcept {
+        RenderThreadStats result;
+        result.handoff_latency = std::chrono::microseconds(handoff_latency_);
+        result.main_wait = std::chrono::microseconds(main_wait_);
+        result.replay_time = std::chrono::microseconds(replay_time_);
+        result.swap_time = std::chrono::microseconds(swap_time_);
+        result.command_count = command_count_;
+        if (result.replay_time.count() > 0) {
+            result.commands_per_second = static_cast<double>(
+                    result.command_count) * 1.0e6 /
+                    static_cast<double>(result.replay_time.count());
+        }
+        return result;
+    }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    static std::int64_t ToMicroseconds(Clock::duration d) noexcept {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d)
+                .count();
+    }
+
+    SDLWindowWrapper& win_;
+    FrameStats& frame_stats_; // REPLAY and SWAP are recorded here
+    std::thread thread_;
+    std::mutex mutex_;
+    std::mutex sync_mutex_;
+    std::condition_variable cv_;
+    CommandBuffer* p_frame_{nullptr};
+    Job* p_sync_{nullptr};
+    std::exception_ptr sync_error_;
+    Clock::time_point submitted_;
+    bool quit_{false};
+
+    // Written by one thread and read by any
+    std::atomic<std::int64_t> handoff_latency_{0};
+    std::atomic<std::int64_t> main_wait_{0};
+    std::atomic<std::int64_t> replay_time_{0};
+    std::atomic<std::int64_t> swap_time_{0};
+    std::atomic<std::size_t> command_count_{0};
+
+    void thread_handler() {
+        GB_PROFILE_THREAD("Render");
+        if (!win_.make_current(true)) {
+            Log::Write(LOG_ERROR, "Render thread context error: %s",
+                    SDL_GetError());
+        }
+        std::unique_lock<std::mutex> lock{mutex_};
+        for (;;) {
+            cv_.wait(lock, [this]() {
+                return (p_sync_ || p_frame_ || quit_);
+            });
+
+            if (p_sync_) {
+                auto* p_job = p_sync_;
+                lock.unlock();
+                std::exception_ptr error;
+                try {
+                    (*p_job)();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                lock.lock();
+                sync_error_ = error;
+                p_sync_ = nullptr;
+                cv_.notify_all();
+            } else if (p_frame_) {
+                // Taking the frame releases end_frame
+                auto* p_buffer = p_frame_;
+                const auto submitted = submitted_;
+                p_frame_ = nullptr;
+                cv_.notify_all();
+                lock.unlock();
+
+                const auto start = Clock::now();
+                command_count_ = p_buffer->replay();
+                const auto replayed = Clock::now();
+                win_.swap_window();
+                const auto swapped = Clock::now();
+                GB_PROFILE_RECORD("Replay", start, replayed);
+                GB_PROFILE_RECORD("Swap", replayed, swapped);
+                handoff_latency_ = ToMicroseconds(start - submitted);
+                replay_time_ = ToMicroseconds(replayed - start);
+                swap_time_ = ToMicroseconds(swapped - replayed);
+                frame_stats_.record(FrameMetric::REPLAY,
+                        std::chrono::microseconds(replay_time_));
+                frame_stats_.record(FrameMetric::SWAP,
+                        std::chrono::microseconds(swap_time_));
+                RecordStateCounters(frame_stats_);
+                lock.lock();
+            } else {
+                break; // quit_
+            }
+        }
+        lock.unlock();
+        win_.make_current(false);
+    }
+};
+
 // Main class
 Window::~Window() {
     Log::Write(LOG_INFO, "Greenbell Window Shutdown");
@@ -142,11 +313,11 @@ Window::Window(WindowInfo win_info) : win_info_(std::move(win_info)) {
     GL::Viewport(0, 0, win_info_.width, win_info_.height);
     GL::ClearColour(0.0f, 0.0f, 0.0f);
     if (win_info_.msaa) glEnable(GL_MULTISAMPLE);
-    glEnable(GL_DEPTH_TEST);
-    glCullFace(GL_BACK);
+    GL::DepthTest(true);
+    GL::State::CullFace(GL_BACK);
 
     // Default colour and blend modes
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    GL::State::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // Check for errors
 #ifdef USE_GET_ERROR
@@ -160,35 +331,132 @@ Window::Window(WindowInfo win_info) : win_info_(std::move(win_info)) {
 
     // Initialize SDL_ttf
     if (!TTF_WasInit() && TTF_Init()) throw TTFException();
+
+    // Everything above needed the context on this thread. From here on it
+    // belongs to the render thread.
+    if (win_info_.render_thread) {
+        ps_render_ = std::make_unique<RenderThread>(*ps_win_, frame_stats_);
+        Log::Write(LOG_INFO, "Render thread started");
+    }
 }
 
 void Window::start_frame() const noexcept {
     time_point_ = std::chrono::steady_clock::now(); // mutable
 }
 
-std::chrono::microseconds Window::end_frame(
+FrameTiming Window::end_frame(
         std::chrono::microseconds min_duration) const noexcept {
-    // Send the OpenGL buffer to the SDL window
-    ps_win_->swap_window();
+    using Clock = std::chrono::steady_clock;
+    const auto to_us = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d);
+    };
+
+    GB_PROFILE_ZONE("Window::end_frame");
+    const auto end_start = Clock::now();
+    frame_stats_.record(FrameMetric::CPU, to_us(end_start - time_point_));
+    if (ps_render_) {
+        // Hand the frame to the render thread and start recording the next
+        // one into the other buffer. It records REPLAY and SWAP itself.
+        ps_render_->submit(command_buffers_[record_index_]);
+        record_index_ ^= 1;
+        frame_stats_.record(FrameMetric::SUBMIT,
+                to_us(Clock::now() - end_start));
+    } else {
+        // Send the OpenGL buffer to the SDL window
+        command_buffers_[record_index_].replay();
+        const auto replayed = Clock::now();
+        ps_win_->swap_window();
+        frame_stats_.record(FrameMetric::REPLAY, to_us(replayed - end_start));
+        frame_stats_.record(FrameMetric::SWAP, to_us(Clock::now() - replayed));
+        RecordStateCounters(frame_stats_);
+    }
 
     // Duration since last update to time_point_
-    const auto now = std::chrono::steady_clock::now();
-    const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
-            now - time_point_);
+    const auto now = Clock::now();
+    FrameTiming timing;
+    timing.duration = to_us(now - time_point_);
 
     // Soft frame limiter
+    auto end = now;
     if (min_duration != LIMITER_DISABLE) {
-        // Shave a bit off the wait for system overhead
-        static constexpr auto LIMITER_TWEAK = std::chrono::microseconds(100);
-        const auto wait = min_duration - duration - LIMITER_TWEAK;
-        // Skip the wait completely for short durations. Note that sleeping
-        // a negative amount is allowed and should return immediately, but
-        // any small value will probably take at least 50us on Linux.
-        if (wait > LIMITER_TWEAK) {
-            std::this_thread::sleep_for(wait);
+        if (win_info_.limiter == FrameLimiter::HYBRID) {
+            limit_hybrid(time_point_ + min_duration);
+        } else {
+            limit_sleep(min_duration - timing.duration);
+        }
+        end = Clock::now();
+        timing.pacing_error = to_us(end - time_point_) - min_duration;
+    }
+    timing.wake_overshoot = wake_overshoot_;
+    if (!frame_stats_.count(FrameMetric::FRAME)) {
+        ProgramCache::LogStats(); // Startup has finished
+    }
+    frame_stats_.record(FrameMetric::LIMITER, to_us(end - now));
+    frame_stats_.record(FrameMetric::FRAME, to_us(end - time_point_));
+    GB_PROFILE_RECORD("Frame", time_point_, end);
+    return timing;
+}
+
+void Window::limit_sleep(std::chrono::microseconds wait) const noexcept {
+    // Shave a bit off the wait for system overhead
+    static constexpr auto LIMITER_TWEAK = std::chrono::microseconds(100);
+    wait -= LIMITER_TWEAK;
+    // Skip the wait completely for short durations. Note that sleeping
+    // a negative amount is allowed and should return immediately, but
+    // any small value will probably take at least 50us on Linux.
+    if (wait > LIMITER_TWEAK) {
+        std::this_thread::sleep_for(wait);
+    }
+}
+
+void Window::limit_hybrid(
+        std::chrono::steady_clock::time_point target) const noexcept {
+    using namespace std::chrono;
+
+    // Extra time left for spinning in case a wake up is later than any seen
+    // so far, and the most overshoot that will be believed
+    static constexpr auto SPIN_MARGIN = microseconds(50);
+    static constexpr auto MAX_OVERSHOOT = microseconds(2000);
+
+    // Sleep only if it would still leave time to spin
+    const auto sleep_until = target - wake_overshoot_ - SPIN_MARGIN;
+    auto now = steady_clock::now();
+    if (sleep_until > now) {
+        const auto wait = duration_cast<microseconds>(sleep_until - now);
+        std::this_thread::sleep_for(wait);
+        now = steady_clock::now();
+
+        // Learn the overshoot. Rise quickly so a slow wake up doesn't make
+        // several frames late in a row, but fall slowly so one lucky wake up
+        // doesn't either.
+        auto late = duration_cast<microseconds>(now - sleep_until);
+        if (late < microseconds(0)) late = microseconds(0);
+        if (late > MAX_OVERSHOOT) late = MAX_OVERSHOOT;
+        if (late > wake_overshoot_) {
+            wake_overshoot_ += (late - wake_overshoot_) / 2;
+        } else {
+            wake_overshoot_ -= (wake_overshoot_ - late) / 16;
         }
     }
-    return duration;
+
+    // Spin for the rest
+    while (now < target) {
+        std::this_thread::yield();
+        now = steady_clock::now();
+    }
+}
+
+void Window::render_sync(Job&& job) const {
+    if (ps_render_) {
+        ps_render_->run_sync(job);
+    } else {
+        job();
+    }
+}
+
+RenderThreadStats Window::render_stats() const noexcept {
+    if (ps_render_) return ps_render_->stats();
+    return RenderThreadStats{};
 }
 
 float Window::aspect_ratio() const noexcept {
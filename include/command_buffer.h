@@ -0,0 +1,75 @@
+// A list of recorded jobs to be replayed later, in order, on another thread
+#ifndef GB_COMMAND_BUFFER_H
+#define GB_COMMAND_BUFFER_H
+
+#include "job.h"
+#include "log.h"
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Greenbell {
+
+// Used by Window to send OpenGL work to the render thread. Any thread may
+// record commands. Replay runs them in the order they were recorded and then
+// clears the buffer, which keeps its capacity so a buffer reused every frame
+// stops allocating once it is big enough.
+//
+// The commands run without the lock held, so they may record more commands,
+// which are left for the next replay. Only one thread may replay at a time.
+class CommandBuffer {
+  public:
+    explicit CommandBuffer(std::size_t capacity = 1024) {
+        commands_.reserve(capacity);
+        replaying_.reserve(capacity);
+    }
+    ~CommandBuffer() = default;
+
+    // No copies or moves
+    CommandBuffer(const CommandBuffer&) = delete;
+    CommandBuffer& operator=(const CommandBuffer&) = delete;
+    CommandBuffer(CommandBuffer&&) = delete;
+    CommandBuffer& operator=(CommandBuffer&&) = delete;
+
+    template <typename F>
+    void record(F&& command) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        commands_.emplace_back(std::forward<F>(command));
+    }
+
+    // Returns the number of commands that were run. A command which throws
+    // is logged and the rest still run, since the frame has to go on.
+    std::size_t replay() noexcept {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            commands_.swap(replaying_); // Both keep their capacity
+        }
+        for (auto& command : replaying_) {
+            try {
+                command();
+            } catch (const std::exception& e) {
+                Log::Write(LOG_ERROR, "CommandBuffer: %s", e.what());
+            } catch (...) {
+                Log::Write(LOG_ERROR, "CommandBuffer: Unknown exception");
+            }
+        }
+        const auto count = replaying_.size();
+        replaying_.clear();
+        return count;
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return commands_.size();
+    }
+
+  private:
+    mutable std::mutex mutex_;
+    std::vector<Job> commands_;
+    std::vector<Job> replaying_; // Only touched by replay
+};
+
+} // namespace Greenbell
+#endif
@@ -0,0 +1,108 @@
+// Turns lots of indexed draws into a few multi-draw indirect calls
+#ifndef GB_DRAW_BATCHER_H
+#define GB_DRAW_BATCHER_H
+
+#include "gl.h"
+#include "radix_sort.h"
+#include "stream_buffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Greenbell {
+
+// Draws are collected with add, then build sorts them by a 64 bit key made
+// from the program, the caller's state number and the VAO, and writes
+// their GL::DEIC commands into a StreamBuffer. Each run of draws sharing all
+// three becomes one glMultiDrawElementsIndirect call from submit.
+//
+// Every draw in a batcher uses the same primitive mode and index type. The
+// meshes must share their VAO's buffers, for example by being allocated
+// from one MeshBuffer page, with their offsets in the commands'
+// first_index and base_vertex.
+//
+// Sorting puts the program in the most significant bits, as the most
+// expensive thing to change, then the state and the VAO. Anything in the
+// key wider than its field only makes the sort less useful, since batches
+// are split by comparing the real values.
+class DrawBatcher {
+  public:
+    struct Batch {
+        GLuint program;
+        GLuint vao;
+        std::uint16_t state;
+        GLintptr offset; // Of the first command in the indirect buffer
+        GLsizei count;
+    };
+
+    explicit DrawBatcher(GLenum mode = GL_TRIANGLES,
+            GLenum index_type = GL_UNSIGNED_INT);
+
+    // Forget the draws from last frame
+    void clear() noexcept;
+
+    // state is a number the caller gives meaning to, such as a blend mode
+    // or PipelineState index, which is passed back in submit
+    void add(GLuint program, GLuint vao, std::uint16_t state,
+            const GL::DEIC& command);
+
+    // Sort and write the commands for this frame. Must be called between
+    // the buffer's begin_frame and end_frame. Returns false if the
+    // commands didn't fit, in which case submit does nothing.
+    bool build(StreamBuffer& indirect);
+
+    // Issue one multi-draw per batch. set_state(std::uint16_t) is called
+    // before the first batch and whenever the state changes.
+    template <typename F>
+    void submit(F&& set_state) {
+        if (!indirect_buffer_) return;
+        begin_submit();
+        for (std::size_t i = 0; i < batches_.size(); ++i) {
+            const auto& batch = batches_[i];
+            if (!i || batch.state != batches_[i - 1].state) {
+                set_state(batch.state);
+            }
+            draw(i);
+        }
+    }
+    void submit() {
+        submit([](std::uint16_t) {});
+    }
+
+    const std::vector<Batch>& batches() const noexcept {
+        return batches_;
+    }
+    std::size_t draws() const noexcept {
+        return draws_.size();
+    }
+
+    static std::uint64_t Key(GLuint program, GLuint vao,
+            std::uint16_t state) noexcept {
+        return (static_cast<std::uint64_t>(program & 0xFFFFFF) << 40) |
+                (static_cast<std::uint64_t>(state) << 24) |
+                (vao & 0xFFFFFF);
+    }
+
+  private:
+    struct Draw {
+        GLuint program;
+        GLuint vao;
+        std::uint16_t state;
+        GL::DEIC command;
+    };
+
+    GLenum mode_;
+    GLenum index_type_;
+    std::vector<Draw> draws_;
+    std::vector<SortItem> order_;
+    std::vector<SortItem> scratch_;
+    std::vector<GL::DEIC> commands_;
+    std::vector<Batch> batches_;
+    GLuint indirect_buffer_{0};
+
+    void begin_submit() const noexcept;
+    void draw(std::size_t batch) const noexcept;
+};
+
+} // namespace Greenbell
+#endif
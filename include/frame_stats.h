@@ -0,0 +1,106 @@
+// Rolling per frame timings and counts which can be read from any thread
+#ifndef GB_FRAME_STATS_H
+#define GB_FRAME_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace Greenbell {
+
+enum class FrameMetric {
+    CPU,     // From start_frame until end_frame was called
+    SUBMIT,  // end_frame waiting for the render thread to take the frame
+    REPLAY,  // Running the recorded commands
+    SWAP,    // Buffer swap, including any vsync wait
+    LIMITER, // Soft frame limiter wait
+    FRAME,   // From start_frame until end_frame returned
+    COUNT
+};
+
+// Things counted once a frame
+enum class FrameCounter {
+    // GL::State calls made by the thread which owns the context
+    STATE_SUBMITTED, // Passed on to OpenGL
+    STATE_SKIPPED,   // Skipped as they wouldn't change anything
+    COUNT
+};
+
+// T is std::chrono::microseconds for a FrameMetric or std::uint64_t for a
+// FrameCounter
+template <typename T>
+struct BasicFrameSummary {
+    T mean{0};
+    T p50{0};
+    T p95{0};
+    T p99{0};
+    T max{0};
+    std::size_t samples{0}; // In the window
+};
+using FrameStatsSummary = BasicFrameSummary<std::chrono::microseconds>;
+using FrameCounterSummary = BasicFrameSummary<std::uint64_t>;
+
+// Keeps the last WINDOW samples of each metric and counter along with a
+// histogram of them, all in fixed memory. Recording is a handful of relaxed
+// atomic operations and never blocks or allocates so it can be left on. Readers
+// never block the recording thread either, but as a result a summary taken
+// while a sample is being recorded may be off by that one sample.
+//
+// Percentiles come from the histogram, which has 8 buckets per power of two,
+// so they are accurate to about 6%. The mean and max are exact.
+class FrameStats {
+  public:
+    static constexpr std::size_t WINDOW = 256; // Samples per metric
+
+    FrameStats() = default;
+    ~FrameStats() = default;
+
+    // No copies or moves
+    FrameStats(const FrameStats&) = delete;
+    FrameStats& operator=(const FrameStats&) = delete;
+    FrameStats(FrameStats&&) = delete;
+    FrameStats& operator=(FrameStats&&) = delete;
+
+    // Any one metric or counter must only be recorded by one thread at a
+    // time
+    void record(FrameMetric metric, std::chrono::microseconds value) noexcept;
+    void record(FrameCounter counter, std::uint64_t value) noexcept;
+
+    // These can be called from any thread
+    FrameStatsSummary summary(FrameMetric metric) const noexcept;
+    FrameCounterSummary summary(FrameCounter counter) const noexcept;
+    std::chrono::microseconds last(FrameMetric metric) const noexcept;
+    std::uint64_t last(FrameCounter counter) const noexcept;
+    // Samples ever recorded
+    std::uint64_t count(FrameMetric metric) const noexcept;
+    std::uint64_t count(FrameCounter counter) const noexcept;
+
+  private:
+    // Values below 2 * SUB_BUCKETS get a bucket each, after that each power
+    // of 2 is split into SUB_BUCKETS. Anything over MAX_VALUE (about four
+    // seconds, or four million) is counted as MAX_VALUE.
+    static constexpr std::uint32_t SUB_BUCKETS = 8;
+    static constexpr std::uint32_t MAX_EXPONENT = 21;
+    static constexpr std::uint32_t MAX_VALUE = (2u << MAX_EXPONENT) - 1;
+    static constexpr std::size_t BUCKET_COUNT =
+            2 * SUB_BUCKETS + (MAX_EXPONENT - 3) * SUB_BUCKETS;
+
+    struct alignas(64) Series {
+        std::atomic<std::uint64_t> count{0}; // Samples ever recorded
+        std::atomic<std::uint64_t> sum{0};   // Of the samples in the window
+        std::atomic<std::uint32_t> window[WINDOW]{};
+        std::atomic<std::uint32_t> buckets[BUCKET_COUNT]{};
+    };
+    Series series_[static_cast<std::size_t>(FrameMetric::COUNT)];
+    Series counters_[static_cast<std::size_t>(FrameCounter::COUNT)];
+
+    static std::size_t BucketIndex(std::uint32_t value) noexcept;
+    static std::uint32_t BucketValue(std::size_t index) noexcept;
+    static void Record(Series& s, std::int64_t value) noexcept;
+    static FrameCounterSummary Summary(const Series& s) noexcept;
+    static std::uint64_t Last(const Series& s) noexcept;
+};
+
+} // namespace Greenbell
+#endif
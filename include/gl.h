@@ -8,6 +8,8 @@
 
 #include "cmake_config.h"
 #include "glad.h"
+#include "gl_state.h"
+#include "shader_reflection.h"
 #include "types.h"
 #include <string_view>
 
@@ -24,6 +26,7 @@ inline constexpr auto VAO_CLASS_TEMPLATE = 2;
 inline constexpr auto RBO_CLASS_TEMPLATE = 3;
 inline constexpr auto FBO_CLASS_TEMPLATE = 4;
 inline constexpr auto SAMPLER_CLASS_TEMPLATE = 5;
+inline constexpr auto QUERY_CLASS_TEMPLATE = 6;
 template <int N>
 class GenericObject {
   public:
@@ -38,6 +41,9 @@ class GenericObject {
             id_ = glCreateProgram();
         } else if constexpr (N == SAMPLER_CLASS_TEMPLATE) {
             glCreateSamplers(1, &id_);
+        } else if constexpr (N == QUERY_CLASS_TEMPLATE) {
+            // glCreateQueries needs the target up front, this doesn't
+            glGenQueries(1, &id_);
         } else {
             glCreateBuffers(1, &id_);
         }
@@ -49,6 +55,7 @@ class GenericObject {
         #ifdef DEBUG_WRAPPERS
         fmt::print(FMT_STRING("GenericObject {} dtor {}\n"), N, id_);
         #endif
+        Forget(id_);
         if constexpr (N == RBO_CLASS_TEMPLATE) {
             glDeleteRenderbuffers(1, &id_);
         } else if constexpr (N == FBO_CLASS_TEMPLATE) {
@@ -59,6 +66,8 @@ class GenericObject {
             glDeleteProgram(id_);
         } else if constexpr (N == SAMPLER_CLASS_TEMPLATE) {
             glDeleteSamplers(1, &id_);
+        } else if constexpr (N == QUERY_CLASS_TEMPLATE) {
+            glDeleteQueries(1, &id_);
         } else {
             glDeleteBuffers(1, &id_);
         }
@@ -80,6 +89,7 @@ class GenericObject {
         if (id_) {
             // We are moving into this. If it already has a buffer, delete
             // it so it can be replaced with source buffer.
+            Forget(id_);
             if constexpr (N == RBO_CLASS_TEMPLATE) {
                 glDeleteRenderbuffers(1, &id_);
             } else if constexpr (N == FBO_CLASS_TEMPLATE) {
@@ -90,6 +100,8 @@ class GenericObject {
                 glDeleteProgram(id_);
             } else if constexpr (N == SAMPLER_CLASS_TEMPLATE) {
                 glDeleteSamplers(1, &id_);                
+            } else if constexpr (N == QUERY_CLASS_TEMPLATE) {
+                glDeleteQueries(1, &id_);
             } else {
                 glDeleteBuffers(1, &id_);
             }
@@ -111,6 +123,21 @@ class GenericObject {
 
   protected:
     GLuint id_{0};
+
+  private:
+    // OpenGL can reuse the name once it's deleted
+    static void Forget(GLuint id) noexcept {
+        if constexpr (N == VAO_CLASS_TEMPLATE) {
+            State::ForgetVertexArray(id);
+        } else if constexpr (N == PROGRAM_CLASS_TEMPLATE) {
+            State::ForgetProgram(id);
+            Shader::ForgetReflection(id);
+        } else if constexpr (N == SAMPLER_CLASS_TEMPLATE) {
+            State::ForgetSampler(id);
+        } else if constexpr (N == BUFFER_CLASS_TEMPLATE) {
+            State::ForgetBuffer(id);
+        }
+    }
 };
 typedef GenericObject<RBO_CLASS_TEMPLATE> RBO;
 typedef GenericObject<FBO_CLASS_TEMPLATE> FBO;
@@ -121,10 +148,10 @@ class BufferObject : public GenericObject<BUFFER_CLASS_TEMPLATE> {
   public:
     // Do not define ctor/dtor so all base class move/copy things will be used
     void bind() const noexcept {
-        glBindBuffer(TARGET, id_);
+        State::BindBuffer(TARGET, id_);
     }
     void unbind() const noexcept {
-        glBindBuffer(TARGET, 0);
+        State::BindBuffer(TARGET, 0);
     }
 };
 typedef BufferObject<GL_ARRAY_BUFFER> VBO;
@@ -136,10 +163,10 @@ class VAO : public GenericObject<VAO_CLASS_TEMPLATE> {
   public:
     // Do not define ctor/dtor so all base class move/copy things will be used
     void bind() const noexcept {
-        glBindVertexArray(id_);
+        State::BindVertexArray(id_);
     }
     void unbind() const noexcept {
-        glBindVertexArray(0);
+        State::BindVertexArray(0);
     }
 };
 
@@ -148,10 +175,39 @@ class SamplerObject : public GenericObject<SAMPLER_CLASS_TEMPLATE> {
   public:
     // Do not define ctor/dtor so all base class move/copy things will be used
     void bind(GLuint texture_unit) const noexcept {
-        glBindSampler(texture_unit, id_);
+        State::BindSampler(texture_unit, id_);
     }
     void unbind(GLuint texture_unit) const noexcept {
-        glBindSampler(texture_unit, 0);
+        State::BindSampler(texture_unit, 0);
+    }
+};
+
+// Class for owning a Query Object. A query can be used with different
+// targets over its lifetime, such as GL_TIME_ELAPSED and then GL_TIMESTAMP.
+class QueryObject : public GenericObject<QUERY_CLASS_TEMPLATE> {
+  public:
+    // Do not define ctor/dtor so all base class move/copy things will be used
+    void begin(GLenum target) const noexcept {
+        glBeginQuery(target, id_);
+    }
+    static void end(GLenum target) noexcept {
+        glEndQuery(target);
+    }
+    // Record the GPU time once all previous commands have completed
+    void timestamp() const noexcept {
+        glQueryCounter(id_, GL_TIMESTAMP);
+    }
+    // Whether result can be called without waiting for the GPU
+    bool available() const noexcept {
+        GLint ret;
+        glGetQueryObjectiv(id_, GL_QUERY_RESULT_AVAILABLE, &ret);
+        return (ret == GL_TRUE);
+    }
+    // Nanoseconds for time queries. Waits if the result is not available.
+    GLuint64 result() const noexcept {
+        GLuint64 ret;
+        glGetQueryObjectui64v(id_, GL_QUERY_RESULT, &ret);
+        return ret;
     }
 };
 
@@ -160,7 +216,7 @@ class ProgramObject : public GenericObject<PROGRAM_CLASS_TEMPLATE> {
   public:
     // Do not define ctor/dtor so all base class move/copy things will be used
     void use() const noexcept {
-         glUseProgram(id_);
+        State::UseProgram(id_);
     }
     void link() const noexcept {
         glLinkProgram(id_);
@@ -280,21 +336,13 @@ struct DEIC {
 // Misc wrapped functions
 // **********************
 inline void DepthTest(bool enable) noexcept {
-    if (enable) {
-        glEnable(GL_DEPTH_TEST);
-    } else {
-        glDisable(GL_DEPTH_TEST);
-    }
+    State::Enable(State::DEPTH_TEST, enable);
 }
 inline void Blend(bool enable) noexcept {
-    if (enable) {
-        glEnable(GL_BLEND);
-    } else {
-        glDisable(GL_BLEND);
-    }
+    State::Enable(State::BLEND, enable);
 }
 inline void SetWireframe(bool value) {
-    glPolygonMode(GL_FRONT_AND_BACK, value ? GL_LINE : GL_FILL);
+    State::PolygonMode(value ? GL_LINE : GL_FILL);
 }
 inline void ClearColour(float red, float green, float blue) {
     glClearColor(red, green, blue, 1.0f);
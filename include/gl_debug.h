@@ -0,0 +1,102 @@
+// Collects KHR_debug messages so a chatty driver doesn't flood the log
+#ifndef GB_GL_DEBUG_H
+#define GB_GL_DEBUG_H
+
+#include "glad.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Greenbell {
+
+// Each distinct (source, type, id) message is logged the first time it is
+// seen. After that repeats are only counted, and update reports the counts
+// once per interval. At most NEW_LIMIT new messages are logged per interval.
+// Any more wait for update to log them in a later interval, so every
+// message is still shown once. Performance messages are also recorded as
+// zones in the CPU profiler so driver stalls can be lined up with the rest
+// of the frame.
+//
+// install, uninstall, mute and filter make OpenGL calls so must be called
+// on the thread which owns the context. The callback and update may run on
+// any thread. Profiler zone names point into this object, so it must
+// outlive any trace written while it was installed.
+class GLDebugMessages {
+  public:
+    static constexpr std::size_t NEW_LIMIT = 32;
+
+    explicit GLDebugMessages(
+            std::chrono::milliseconds interval = std::chrono::seconds(1));
+    ~GLDebugMessages();
+
+    // No copies or moves since OpenGL keeps a pointer to this
+    GLDebugMessages(const GLDebugMessages&) = delete;
+    GLDebugMessages& operator=(const GLDebugMessages&) = delete;
+    GLDebugMessages(GLDebugMessages&&) = delete;
+    GLDebugMessages& operator=(GLDebugMessages&&) = delete;
+
+    // Enable debug output and take over the debug message callback.
+    // Synchronous output makes messages arrive on the thread making the
+    // call that caused them, which is slower but needed to throw.
+    void install(bool synchronous = false);
+    void uninstall();
+
+    // Stop or restart the driver sending a message. Ids are only unique
+    // within a source and type, and OpenGL requires both to pick ids.
+    void mute(GLenum source, GLenum type, GLuint id, bool muted = true);
+
+    // Enable or disable whole groups of messages. GL_DONT_CARE matches
+    // anything.
+    void filter(GLenum source, GLenum type, GLenum severity, bool enabled);
+
+    // Throw from the callback on GL_DEBUG_TYPE_ERROR like
+    // Log::MessageCallback does. Only safe with synchronous output.
+    void set_throw_on_error(bool enabled) noexcept {
+        throw_on_error_ = enabled;
+    }
+
+    // Log the repeat counts if the interval has passed. Call once a frame.
+    void update();
+
+    // Times a message has been received in total
+    std::uint64_t count(GLenum source, GLenum type, GLuint id) const;
+
+  private:
+    struct Entry {
+        GLenum source;
+        GLenum type;
+        GLenum severity;
+        GLuint id;
+        std::string message;
+        std::uint64_t total{0};
+        std::uint64_t repeats{0}; // Since the last report
+        bool shown{false}; // Logged, or still waiting for a free interval
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    // The callback is only given a const pointer so anything it changes is
+    // mutable, and guarded by the mutex
+    mutable std::mutex mutex_;
+    mutable std::unordered_map<std::uint64_t, Entry> entries_;
+    mutable std::size_t new_this_interval_{0};
+    mutable std::size_t waiting_{0}; // New but not shown yet
+    std::chrono::milliseconds interval_;
+    Clock::time_point next_report_;
+    bool throw_on_error_{false};
+    bool installed_{false};
+
+    static std::uint64_t Key(GLenum source, GLenum type, GLuint id) noexcept;
+    static void APIENTRY Callback(GLenum source, GLenum type, GLuint id,
+            GLenum severity, GLsizei length, const GLchar* message,
+            const void* user_param);
+    void receive(GLenum source, GLenum type, GLuint id, GLenum severity,
+            const GLchar* message) const;
+    void show(Entry& e) const;
+};
+
+} // namespace Greenbell
+#endif
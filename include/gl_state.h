@@ -0,0 +1,232 @@
+// Skips OpenGL binds and enables which wouldn't change anything
+#ifndef GB_GL_STATE_H
+#define GB_GL_STATE_H
+
+#include "cmake_config.h" /* DEBUG_GL_STATE */
+#include "glad.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace Greenbell::GL::State {
+
+// A shadow copy of the state which the GL wrappers set, so setting what is
+// already set can be skipped. A context is only current on one thread at a
+// time, so the shadow is kept per thread and needs no locking.
+//
+// Anything set by calling OpenGL directly isn't seen, so after doing that
+// call Invalidate, which makes the next call for everything go through.
+// Making a context current does that automatically. Deleting objects
+// through the wrappers forgets their names, since OpenGL can reuse them.
+//
+// With the DEBUG_GL_STATE cmake option every skipped call first checks the
+// shadow against glGet, and logs if they differ. Verify does the same for
+// all of it on demand.
+
+inline constexpr GLuint UNKNOWN = static_cast<GLuint>(-1);
+inline constexpr std::size_t SAMPLER_UNITS = 32;
+
+enum Buffer { ARRAY, ELEMENT_ARRAY, UNIFORM, DRAW_INDIRECT, BUFFER_COUNT };
+enum Capability { DEPTH_TEST, BLEND, CULL_FACE, CAPABILITY_COUNT };
+
+struct Counters {
+    std::uint64_t submitted{0}; // Calls which went through to OpenGL
+    std::uint64_t skipped{0};
+};
+
+template <std::size_t N>
+constexpr std::array<GLuint, N> Unknown() noexcept {
+    std::array<GLuint, N> ret{};
+    for (auto& value : ret) value = UNKNOWN;
+    return ret;
+}
+
+// Everything has a constant initial value, so the thread_local below is
+// initialised without the guard a constructor call would need on every use
+struct Shadow {
+    GLuint program{UNKNOWN};
+    GLuint vao{UNKNOWN};
+    std::array<GLuint, BUFFER_COUNT> buffers{Unknown<BUFFER_COUNT>()};
+    std::array<GLuint, SAMPLER_UNITS> samplers{Unknown<SAMPLER_UNITS>()};
+    // GL_TRUE, GL_FALSE or UNKNOWN
+    std::array<GLuint, CAPABILITY_COUNT> capabilities{
+            Unknown<CAPABILITY_COUNT>()};
+    GLuint cull_face{UNKNOWN};
+    GLuint polygon_mode{UNKNOWN};
+    GLuint depth_mask{UNKNOWN};
+    GLuint depth_func{UNKNOWN};
+    GLuint blend_func{UNKNOWN}; // Source factor << 16 | destination factor
+    GLuint blend_equation{UNKNOWN};
+    Counters counters;
+
+    void invalidate() noexcept {
+        const auto kept = counters;
+        *this = Shadow{};
+        counters = kept;
+    }
+};
+static_assert(Shadow{}.samplers[SAMPLER_UNITS - 1] == UNKNOWN,
+        "Shadow must be constant initialised");
+
+inline thread_local Shadow tl_shadow;
+
+// Log any differences between the shadow and OpenGL. Returns how many.
+std::size_t Verify();
+// Used by DEBUG_GL_STATE, where what is the glGet enum
+void VerifyValue(GLenum what, GLint index, GLuint expected);
+
+inline void Invalidate() noexcept {
+    tl_shadow.invalidate();
+}
+
+// Counts since the last call on this thread
+inline Counters TakeCounters() noexcept {
+    const auto ret = tl_shadow.counters;
+    tl_shadow.counters = Counters{};
+    return ret;
+}
+
+// Update the shadow and return true if the call is needed
+inline bool Change(GLuint& shadow, GLuint value,
+        [[maybe_unused]] GLenum what,
+        [[maybe_unused]] GLint index = -1) noexcept {
+    if (shadow == value) {
+        #ifdef DEBUG_GL_STATE
+        VerifyValue(what, index, value);
+        #endif
+        ++tl_shadow.counters.skipped;
+        return false;
+    }
+    shadow = value;
+    ++tl_shadow.counters.submitted;
+    return true;
+}
+
+inline void UseProgram(GLuint program) noexcept {
+    if (Change(tl_shadow.program, program, GL_CURRENT_PROGRAM)) {
+        glUseProgram(program);
+    }
+}
+
+inline void BindVertexArray(GLuint vao) noexcept {
+    if (Change(tl_shadow.vao, vao, GL_VERTEX_ARRAY_BINDING)) {
+        glBindVertexArray(vao);
+        // The element array buffer belongs to the VAO
+        tl_shadow.buffers[ELEMENT_ARRAY] = UNKNOWN;
+    }
+}
+
+inline void BindBuffer(GLenum target, GLuint buffer) noexcept {
+    Buffer slot;
+    GLenum binding;
+    switch (target) {
+        case GL_ARRAY_BUFFER:
+            slot = ARRAY;
+            binding = GL_ARRAY_BUFFER_BINDING;
+            break;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            slot = ELEMENT_ARRAY;
+            binding = GL_ELEMENT_ARRAY_BUFFER_BINDING;
+            break;
+        case GL_UNIFORM_BUFFER:
+            slot = UNIFORM;
+            binding = GL_UNIFORM_BUFFER_BINDING;
+            break;
+        case GL_DRAW_INDIRECT_BUFFER:
+            slot = DRAW_INDIRECT;
+            binding = GL_DRAW_INDIRECT_BUFFER_BINDING;
+            break;
+        default: // Not tracked
+            ++tl_shadow.counters.submitted;
+            glBindBuffer(target, buffer);
+            return;
+    }
+    if (Change(tl_shadow.buffers[slot], buffer, binding)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+inline void BindSampler(GLuint unit, GLuint sampler) noexcept {
+    if (unit >= SAMPLER_UNITS) {
+        ++tl_shadow.counters.submitted;
+        glBindSampler(unit, sampler);
+        return;
+    }
+    if (Change(tl_shadow.samplers[unit], sampler, GL_SAMPLER_BINDING,
+            static_cast<GLint>(unit))) {
+        glBindSampler(unit, sampler);
+    }
+}
+
+inline void Enable(Capability capability, bool enable) noexcept {
+    static constexpr GLenum caps[CAPABILITY_COUNT] = {
+        GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE};
+    const auto cap = caps[capability];
+    if (Change(tl_shadow.capabilities[capability],
+            enable ? GL_TRUE : GL_FALSE, cap)) {
+        if (enable) {
+            glEnable(cap);
+        } else {
+            glDisable(cap);
+        }
+    }
+}
+
+inline void CullFace(GLenum mode) noexcept {
+    if (Change(tl_shadow.cull_face, mode, GL_CULL_FACE_MODE)) glCullFace(mode);
+}
+
+// Front and back together, the only choice in a core profile
+inline void PolygonMode(GLenum mode) noexcept {
+    if (Change(tl_shadow.polygon_mode, mode, GL_POLYGON_MODE)) {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+}
+
+inline void DepthMask(bool write) noexcept {
+    if (Change(tl_shadow.depth_mask, write ? GL_TRUE : GL_FALSE,
+            GL_DEPTH_WRITEMASK)) {
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+}
+
+inline void DepthFunc(GLenum func) noexcept {
+    if (Change(tl_shadow.depth_func, func, GL_DEPTH_FUNC)) glDepthFunc(func);
+}
+
+// Blend factors all fit in 16 bits
+inline void BlendFunc(GLenum source, GLenum destination) noexcept {
+    if (Change(tl_shadow.blend_func, (source << 16) | destination,
+            GL_BLEND_SRC_RGB)) {
+        glBlendFunc(source, destination);
+    }
+}
+
+inline void BlendEquation(GLenum mode) noexcept {
+    if (Change(tl_shadow.blend_equation, mode, GL_BLEND_EQUATION_RGB)) {
+        glBlendEquation(mode);
+    }
+}
+
+// Called before an object is deleted
+inline void ForgetProgram(GLuint program) noexcept {
+    // A deleted program stays in use until another is, so its name mustn't
+    // match a new program with the same name
+    if (tl_shadow.program == program) tl_shadow.program = UNKNOWN;
+}
+inline void ForgetVertexArray(GLuint vao) noexcept {
+    if (tl_shadow.vao == vao) tl_shadow.vao = UNKNOWN;
+}
+inline void ForgetBuffer(GLuint buffer) noexcept {
+    for (auto& b : tl_shadow.buffers) {
+        if (b == buffer) b = UNKNOWN;
+    }
+}
+inline void ForgetSampler(GLuint sampler) noexcept {
+    for (auto& s : tl_shadow.samplers) {
+        if (s == sampler) s = UNKNOWN;
+    }
+}
+
+} // namespace Greenbell::GL::State
+#endif
@@ -0,0 +1,122 @@
+// Measures how long the GPU spends on each pass of a frame
+#ifndef GB_GPU_PROFILER_H
+#define GB_GPU_PROFILER_H
+
+#include "gl.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Greenbell {
+
+// Each scope writes a GPU timestamp at its beginning and end. The results
+// aren't read back until the same slot comes around again FRAMES later, by
+// which time the GPU has normally finished with them, so reading never waits
+// on the GPU. If it hasn't finished that frame is not profiled rather than
+// wait, and dropped() counts it.
+//
+// All the calls make OpenGL calls so must be made on the thread which owns
+// the context. With a Window render thread that means recording them into
+// Window::commands along with the passes being measured.
+class GpuProfiler {
+  public:
+    static constexpr std::size_t NO_SCOPE = static_cast<std::size_t>(-1);
+
+    struct PassTime {
+        const char* name;
+        std::chrono::microseconds gpu_time;
+        int depth; // Nesting, 0 for outermost scopes
+    };
+
+    explicit GpuProfiler(std::size_t frames = 4);
+    ~GpuProfiler() = default;
+
+    // No copies, but queries can be moved
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+    GpuProfiler(GpuProfiler&&) = default;
+    GpuProfiler& operator=(GpuProfiler&&) = default;
+
+    // Every begin_frame must be matched by end_frame. The CPU frame time, for
+    // example from Window::end_frame, is reported with the frame's results
+    // so the two can be compared.
+    void begin_frame();
+    void end_frame(std::chrono::microseconds cpu_time = {});
+
+    // Scopes can nest but must be ended in reverse order. The name must be
+    // a string literal or otherwise outlive the profiler.
+    std::size_t begin(const char* name);
+    void end(std::size_t scope);
+
+    // Results of the most recent frame which has been read back
+    const std::vector<PassTime>& passes() const noexcept {
+        return passes_;
+    }
+    std::chrono::microseconds gpu_time() const noexcept {
+        return gpu_time_;
+    }
+    std::chrono::microseconds cpu_time() const noexcept {
+        return cpu_time_;
+    }
+    std::uint64_t frame() const noexcept {
+        return frame_; // Which begin_frame the results are from
+    }
+    std::uint64_t dropped() const noexcept {
+        return dropped_;
+    }
+
+  private:
+    struct Scope {
+        const char* name;
+        std::size_t begin;
+        std::size_t end;
+        int depth;
+    };
+
+    // Queries are kept between uses so only the first few frames create any
+    struct Frame {
+        std::vector<GL::QueryObject> queries;
+        std::vector<Scope> scopes;
+        std::size_t used{0};
+        std::chrono::microseconds cpu_time{0};
+        std::uint64_t number{0};
+        bool pending{false};
+    };
+
+    std::vector<Frame> frames_;
+    std::size_t current_{0};
+    std::uint64_t frame_count_{0};
+    bool recording_{false};
+    int depth_{0};
+
+    std::vector<PassTime> passes_;
+    std::chrono::microseconds gpu_time_{0};
+    std::chrono::microseconds cpu_time_{0};
+    std::uint64_t frame_{0};
+    std::uint64_t dropped_{0};
+
+    std::size_t timestamp(Frame& f);
+    bool collect(Frame& f);
+};
+
+// Times a scope from construction until destruction
+class GpuScope {
+  public:
+    GpuScope(GpuProfiler& profiler, const char* name)
+            : profiler_{profiler}, scope_{profiler.begin(name)} {}
+    ~GpuScope() {
+        profiler_.end(scope_);
+    }
+    GpuScope(const GpuScope&) = delete;
+    GpuScope& operator=(const GpuScope&) = delete;
+    GpuScope(GpuScope&&) = delete;
+    GpuScope& operator=(GpuScope&&) = delete;
+
+  private:
+    GpuProfiler& profiler_;
+    std::size_t scope_;
+};
+
+} // namespace Greenbell
+#endif
@@ -0,0 +1,169 @@
+// Move only "void func(void)" callable with inline storage, and a ring buffer
+// for holding them, so that passing jobs around never touches the heap
+#ifndef GB_JOB_H
+#define GB_JOB_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Greenbell {
+
+// Unlike std::function the captures are always stored inside the Job itself.
+// A capture that doesn't fit is a compile error rather than a hidden heap
+// allocation, so capture large things by pointer or reference instead.
+class Job {
+  public:
+    // Sized so a whole Job fits in one 64 byte cache line
+    static constexpr std::size_t CAPACITY = 64 - sizeof(void*);
+
+    Job() noexcept = default;
+    Job(std::nullptr_t) noexcept {}
+
+    template <typename F, typename = std::enable_if_t<
+            !std::is_same_v<std::decay_t<F>, Job> &&
+            !std::is_same_v<std::decay_t<F>, std::nullptr_t>>>
+    Job(F&& f) { // Implicit so lambdas can be passed as Jobs NOLINT
+        using T = std::decay_t<F>;
+        static_assert(sizeof(T) <= CAPACITY,
+                "Job capture is too large for inline storage");
+        static_assert(alignof(T) <= alignof(void*),
+                "Job capture is over aligned");
+        static_assert(std::is_nothrow_move_constructible_v<T>,
+                "Job capture must be nothrow move constructible");
+        static_assert(std::is_invocable_v<T&>,
+                "Job must be callable with no parameters");
+        ::new (static_cast<void*>(storage_)) T(std::forward<F>(f));
+        p_ops_ = &OPS<T>;
+    }
+
+    ~Job() noexcept {
+        reset();
+    }
+
+    Job(const Job&) = delete;            // No copy
+    Job& operator=(const Job&) = delete; // No copy assign
+    Job(Job&& source) noexcept {
+        take(source);
+    } // Move
+    Job& operator=(Job&& source) noexcept {
+        if (&source == this) return *this; // Self assignment
+        reset();
+        take(source);
+        return *this;
+    } // Move assign
+    Job& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    explicit operator bool() const noexcept {
+        return p_ops_;
+    }
+
+    // Jobs may be run more than once
+    void operator()() {
+        p_ops_->invoke(storage_);
+    }
+
+    // Destroy the captures now rather than waiting for the destructor
+    void reset() noexcept {
+        if (p_ops_) {
+            p_ops_->destroy(storage_);
+            p_ops_ = nullptr;
+        }
+    }
+
+  private:
+    struct Ops {
+        void (*invoke)(void*);
+        void (*move)(void* dst, void* src) noexcept; // Also destroys src
+        void (*destroy)(void*) noexcept;
+    };
+
+    template <typename T>
+    static constexpr Ops OPS = {
+        [](void* p) { (*static_cast<T*>(p))(); },
+        [](void* dst, void* src) noexcept {
+            ::new (dst) T(std::move(*static_cast<T*>(src)));
+            static_cast<T*>(src)->~T();
+        },
+        [](void* p) noexcept { static_cast<T*>(p)->~T(); },
+    };
+
+    void take(Job& source) noexcept {
+        if (source.p_ops_) {
+            source.p_ops_->move(storage_, source.storage_);
+            p_ops_ = source.p_ops_;
+            source.p_ops_ = nullptr;
+        }
+    }
+
+    const Ops* p_ops_{nullptr};
+    // Pointer alignment covers any capture of pointers, references and
+    // scalars, and unlike max_align_t leaves no padding after p_ops_
+    alignas(void*) unsigned char storage_[CAPACITY];
+};
+static_assert(sizeof(Job) == 64, "Job should fill one cache line");
+
+// Double ended ring buffer of jobs. Slots are reused so once it has grown
+// large enough for the workload pushing and popping never allocates. It only
+// grows (by doubling) when pushing into a full ring.
+class JobRing {
+  public:
+    explicit JobRing(std::size_t capacity = 256) {
+        std::size_t size = 1;
+        while (size < capacity) size <<= 1;
+        slots_.resize(size);
+    }
+
+    bool empty() const noexcept {
+        return !count_;
+    }
+    std::size_t size() const noexcept {
+        return count_;
+    }
+
+    void push_back(Job&& job) {
+        if (count_ == slots_.size()) grow();
+        slots_[(head_ + count_) & (slots_.size() - 1)] = std::move(job);
+        ++count_;
+    }
+    void push_front(Job&& job) {
+        if (count_ == slots_.size()) grow();
+        head_ = (head_ - 1) & (slots_.size() - 1);
+        slots_[head_] = std::move(job);
+        ++count_;
+    }
+
+    // Popping an empty ring is not allowed
+    Job pop_back() noexcept {
+        --count_;
+        return std::move(slots_[(head_ + count_) & (slots_.size() - 1)]);
+    }
+    Job pop_front() noexcept {
+        auto& slot = slots_[head_];
+        head_ = (head_ + 1) & (slots_.size() - 1);
+        --count_;
+        return std::move(slot);
+    }
+
+  private:
+    std::vector<Job> slots_; // Size is always a power of 2
+    std::size_t head_{0};
+    std::size_t count_{0};
+
+    void grow() {
+        std::vector<Job> larger(slots_.size() * 2);
+        for (std::size_t i = 0; i < count_; ++i) {
+            larger[i] = std::move(slots_[(head_ + i) & (slots_.size() - 1)]);
+        }
+        slots_.swap(larger);
+        head_ = 0;
+    }
+};
+
+} // namespace Greenbell
+#endif
@@ -2,72 +2,292 @@
 #ifndef GB_LOG_H
 #define GB_LOG_H
 
+#include "cmake_config.h" /* GB_LOG_COMPILE_LEVEL */
 #include "glad.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include <string>
 #include <string_view>
+#include <type_traits>
 
 namespace Greenbell {
 
 enum LogLevel { LOG_ERROR, LOG_INFO, LOG_TRACE };
 
+// Most detailed level which GB_LOG calls are compiled in for
+#ifndef GB_LOG_COMPILE_LEVEL /* From cmake_config.h */
+#define GB_LOG_COMPILE_LEVEL LOG_TRACE
+#endif
+
 namespace Log {
 
 // Return current level
 LogLevel Level();
 
-// "Write" is partially thread safe, as calling it from multiple threads
-// should not cause a crash but could mix multiple messages together.
+// Each message is written as a whole so messages from different threads
+// never interleave. Normally it is written before Write returns. After
+// StartAsync it is copied into a ring buffer belonging to the calling thread
+// and a background thread writes everything out in batches, so Write never
+// waits on the console.
+void Output(LogLevel level, std::string_view message);
+
+// Stream for formatting a message on this thread, emptied for reuse
+std::ostringstream& FormatStream();
+
 inline void Write(LogLevel level, const char* s) {
     if (level <= Level()) {
-        if (level == LOG_ERROR) {
-            while (s and *s) {
-                std::cerr << *s++;
-            }
-            std::cerr << "\n";
-        } else {
-            while (s and *s) {
-                std::cout << *s++;
-            }
-            std::cout << "\n";
-        }
+        Output(level, s ? std::string_view{s} : std::string_view{});
     }
 }
 
 inline void Write(LogLevel level, std::string_view sv) {
     if (level <= Level()) {
-        if (level == LOG_ERROR) {
-            std::cerr << sv << "\n";
-        } else {
-            std::cout << sv << "\n";
+        Output(level, sv);
+    }
+}
+
+// Each '%' and the character after it are replaced by the next value. Use
+// "%%" for a '%'. Once the values run out the rest is written as is.
+inline void Format(std::ostream& os, const char* s) {
+    if (s) os << s;
+}
+
+template<typename T, typename... Args>
+void Format(std::ostream& os, const char* s, T value, Args... args) {
+    while (s and *s) {
+        if (*s == '%' and *++s != '%') {
+            os << value;
+            if (*s) ++s; // Allow a trailing '%'
+            return Format(os, s, args...);
         }
+        os << *s++;
     }
 }
 
 template<typename T, typename... Args>
 void Write(LogLevel level, const char* s, T value, Args... args) {
     if (level <= Level()) {
-        if (level == LOG_ERROR) {
-            while (s and *s) {
-                if (*s == '%' and *++s != '%') {
-                    std::cerr << value;
-                    return Write(level, ++s, args...);
-                }
-                std::cerr << *s++;
-            }
-            std::cerr << "\n";
+        auto& os = FormatStream();
+        Format(os, s, value, args...);
+        Output(level, os.str());
+    }
+}
+
+// Move writing to a background thread, or back again. StopAsync writes
+// everything that was queued before it returns.
+void StartAsync();
+void StopAsync();
+
+// Wait until everything logged so far has been written
+void Flush();
+
+// Messages lost because a thread's ring buffer was full
+std::uint64_t Dropped();
+
+// Write everything to a compact binary file instead of the console, which
+// the log_decode tool turns back into text. Errors are still written to the
+// console too. Starts async logging if it isn't already. Throws if the file
+// can't be opened. The file is closed by CloseBinary or StopAsync.
+void OpenBinary(const std::string& path);
+void CloseBinary();
+
+// Deferred logging
+// ****************
+// GB_LOG(level, "format %d", args...) is an alternative to Write for hot
+// paths. The format string is split up at compile time and checked against
+// the number of arguments. Logging only copies the arguments into a binary
+// record in the thread's ring buffer; turning that into text is left to the
+// background thread. Without StartAsync records are formatted immediately.
+// Calls for levels more detailed than GB_LOG_COMPILE_LEVEL compile to
+// nothing. Arguments may be numbers, bools, chars, strings and pointers.
+// Strings are copied so don't need to outlive the call.
+
+// How an argument is stored in a record
+enum class LogArg : std::uint8_t { BOOL, CHAR, INT, UINT, FLOAT, POINTER,
+        STRING };
+
+// Text from the format string, followed by an argument if arg is set
+struct LogPiece {
+    std::uint32_t offset;
+    std::uint32_t length;
+    bool arg;
+};
+
+// Everything known at compile time about a GB_LOG call
+struct LogFormat {
+    const char* format;
+    LogLevel level;
+    const LogPiece* p_pieces;
+    std::size_t piece_count;
+    const LogArg* p_args;
+    std::size_t arg_count;
+};
+
+// Get space for a record's arguments and then send it. Reserve always
+// returns somewhere to write even if the record will be dropped.
+char* ReserveRecord(const LogFormat& format, std::size_t size);
+void CommitRecord();
+
+// Append the text of a record of size bytes to a string. False if the data
+// doesn't hold exactly the format's arguments, and then only part of the
+// text may have been appended.
+bool DecodeRecord(const LogFormat& format, const char* p_data,
+        std::size_t size, std::string& text);
+
+constexpr bool Compiled(LogLevel level) noexcept {
+    return level <= GB_LOG_COMPILE_LEVEL;
+}
+
+namespace Detail {
+
+// Same rules as Format: '%' and the following character are replaced and
+// "%%" is a '%'
+constexpr std::size_t CountPercent(const char* s) noexcept {
+    std::size_t count = 0;
+    for (; *s; ++s) {
+        if (*s == '%') ++count;
+    }
+    return count;
+}
+
+template <std::size_t N>
+struct Pieces {
+    std::array<LogPiece, N> pieces{};
+    std::size_t count{0};
+    std::size_t args{0};
+};
+
+template <std::size_t N>
+constexpr Pieces<N> Split(const char* s) noexcept {
+    Pieces<N> result;
+    std::uint32_t start = 0;
+    std::uint32_t i = 0;
+    const auto add = [&result, &start](std::uint32_t end, bool arg) {
+        result.pieces[result.count++] = LogPiece{start, end - start, arg};
+        if (arg) ++result.args;
+    };
+    while (s[i]) {
+        if (s[i] != '%') {
+            ++i;
+        } else if (s[i + 1] == '%') {
+            add(i + 1, false); // Keep one '%'
+            start = i += 2;
+        } else {
+            add(i, true);
+            start = i += (s[i + 1] ? 2 : 1);
+        }
+    }
+    add(i, false);
+    return result;
+}
+
+template <typename T>
+struct Unsupported : std::false_type {};
+
+// Only char is a character. Unlike Write, which streams them, signed char,
+// unsigned char and so std::int8_t and std::uint8_t are logged as numbers.
+template <typename T>
+constexpr LogArg ArgType() noexcept {
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same_v<U, bool>) {
+        return LogArg::BOOL;
+    } else if constexpr (std::is_same_v<U, char>) {
+        return LogArg::CHAR;
+    } else if constexpr (std::is_enum_v<U> ||
+            (std::is_integral_v<U> && std::is_signed_v<U>)) {
+        return LogArg::INT;
+    } else if constexpr (std::is_integral_v<U>) {
+        return LogArg::UINT;
+    } else if constexpr (std::is_floating_point_v<U>) {
+        return LogArg::FLOAT;
+    } else if constexpr (std::is_convertible_v<U, std::string_view>) {
+        return LogArg::STRING;
+    } else if constexpr (std::is_pointer_v<U>) {
+        return LogArg::POINTER;
+    } else {
+        static_assert(Unsupported<U>::value, "GB_LOG argument type");
+        return LogArg::INT;
+    }
+}
+
+inline std::string_view AsString(const char* s) noexcept {
+    return s ? std::string_view{s} : std::string_view{};
+}
+inline std::string_view AsString(std::string_view s) noexcept {
+    return s;
+}
+
+template <typename T>
+std::size_t ArgSize(const T& value) noexcept {
+    constexpr auto type = ArgType<T>();
+    if constexpr (type == LogArg::BOOL || type == LogArg::CHAR) {
+        return 1;
+    } else if constexpr (type == LogArg::STRING) {
+        return sizeof(std::uint32_t) + AsString(value).size();
+    } else {
+        return 8;
+    }
+}
+
+template <typename T>
+char* Put(char* p, const T& value) noexcept {
+    constexpr auto type = ArgType<T>();
+    if constexpr (type == LogArg::BOOL || type == LogArg::CHAR) {
+        *p = static_cast<char>(value);
+        return p + 1;
+    } else if constexpr (type == LogArg::STRING) {
+        const auto sv = AsString(value);
+        const auto length = static_cast<std::uint32_t>(sv.size());
+        std::memcpy(p, &length, sizeof(length));
+        if (length) std::memcpy(p + sizeof(length), sv.data(), length);
+        return p + sizeof(length) + sv.size();
+    } else {
+        // Widen everything else to 8 bytes
+        using Wide = std::conditional_t<type == LogArg::INT, std::int64_t,
+                std::conditional_t<type == LogArg::UINT, std::uint64_t,
+                std::conditional_t<type == LogArg::FLOAT, double,
+                std::uintptr_t>>>;
+        Wide wide;
+        if constexpr (type == LogArg::POINTER) {
+            wide = reinterpret_cast<std::uintptr_t>(value);
         } else {
-            while (s and *s) {
-                if (*s == '%' and *++s != '%') {
-                    std::cout << value;
-                    return Write(level, ++s, args...);
-                }
-                std::cout << *s++;
-            }
-            std::cout << "\n";
+            wide = static_cast<Wide>(value);
         }
+        std::memcpy(p, &wide, sizeof(wide));
+        return p + sizeof(wide);
     }
 }
 
+// One per GB_LOG call. F::get returns the format string, which makes the
+// string usable at compile time.
+template <typename F, LogLevel LEVEL, typename... Args>
+struct Site {
+    static constexpr const char* FORMAT = F::get();
+    static constexpr auto SPLIT = Split<CountPercent(FORMAT) + 1>(FORMAT);
+    static_assert(SPLIT.args == sizeof...(Args),
+            "GB_LOG format doesn't match the number of arguments");
+    static constexpr std::array<LogArg, sizeof...(Args) + 1> ARGS{
+            ArgType<Args>()..., LogArg::INT};
+    static constexpr LogFormat INFO{FORMAT, LEVEL, SPLIT.pieces.data(),
+            SPLIT.count, ARGS.data(), sizeof...(Args)};
+};
+
+template <typename F, LogLevel LEVEL, typename... Args>
+void Record(const char* /* format */, const Args&... args) {
+    if (LEVEL > Level()) return;
+    const auto& info = Site<F, LEVEL, Args...>::INFO;
+    [[maybe_unused]] auto* p = ReserveRecord(info,
+            (std::size_t{0} + ... + ArgSize(args)));
+    ((p = Put(p, args)), ...);
+    CommitRecord();
+}
+
+} // namespace Detail
+
 // Write an error message for the results of a glGetError
 void WriteGLError(unsigned int error);
 
@@ -77,11 +297,37 @@ void WriteGLError(unsigned int error);
 // changed by another thread is not much of a problem.
 void SetLevel(LogLevel level);
 
-// Callback for use with glDebugMessageCallback
+// Names for the enums of a KHR_debug message
+const char* DebugSourceName(GLenum source) noexcept;
+const char* DebugTypeName(GLenum type) noexcept;
+const char* DebugSeverityName(GLenum severity) noexcept;
+
+// Callback for use with glDebugMessageCallback. Prints every message and
+// throws on errors. See GLDebugMessages for something quieter.
 void MessageCallback(GLenum source, GLenum type, GLuint id,
         GLenum severity, GLsizei length, GLchar const* message,
         void const* user_param);
 
 } // namespace Log
 } // namespace Greenbell
+
+// The first argument is always the format string. Doing it this way rather
+// than a separate parameter means no arguments after the format is allowed
+// without relying on compiler extensions.
+#define GB_LOG_FIRST_(first, ...) first
+#define GB_LOG_FIRST(...) GB_LOG_FIRST_(__VA_ARGS__, 0)
+
+#define GB_LOG(level, ...) \
+    do { \
+        if constexpr (::Greenbell::Log::Compiled(level)) { \
+            struct GbLogFormat { \
+                static constexpr const char* get() { \
+                    return GB_LOG_FIRST(__VA_ARGS__); \
+                } \
+            }; \
+            ::Greenbell::Log::Detail::Record<GbLogFormat, level>( \
+                    __VA_ARGS__); \
+        } \
+    } while (false)
+
 #endif
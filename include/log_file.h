@@ -0,0 +1,29 @@
+// Layout of the binary log files written by Log::OpenBinary
+#ifndef GB_LOG_FILE_H
+#define GB_LOG_FILE_H
+
+#include <cstdint>
+
+namespace Greenbell::LogFile {
+
+// A file is MAGIC followed by entries, each starting with a one byte Entry.
+// Numbers are in the byte order of the machine which wrote the file. Times
+// are nanoseconds since the system clock epoch and threads are numbered in
+// the order they first logged.
+//
+// FORMAT   u32 id, u8 level, u32 length, format string,
+//          u32 piece count, pieces (u32 offset, u32 length, u8 arg),
+//          u32 arg count, arg types (u8 LogArg)
+// RECORD   u32 format id, u32 thread, i64 time, u32 size, arguments
+//          encoded as by GB_LOG
+// TEXT     u8 level, u32 thread, i64 time, u32 length, message
+// DROPPED  u64 messages lost since the last DROPPED
+//
+// A FORMAT always comes before the first RECORD using its id.
+
+inline constexpr char MAGIC[8] = {'G', 'B', 'L', 'O', 'G', '\0', '\0', '1'};
+
+enum Entry : std::uint8_t { FORMAT = 1, RECORD = 2, TEXT = 3, DROPPED = 4 };
+
+} // namespace Greenbell::LogFile
+#endif
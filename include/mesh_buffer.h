@@ -0,0 +1,98 @@
+// Many meshes sharing a few large vertex or index buffers
+#ifndef GB_MESH_BUFFER_H
+#define GB_MESH_BUFFER_H
+
+#include "gl.h"
+#include "range_allocator.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Greenbell {
+
+// Instead of two buffer objects per mesh, meshes get ranges of large pages
+// of immutable storage. A MeshBuffer holds elements of one size, so use one
+// for each vertex format and one for indices. Since ranges are counted in
+// whole elements a range's offset can be used as the base vertex or first
+// index of a draw, so every mesh in a page draws with the same VAO binding
+// and can go into one multi-draw call.
+//
+// Pages are allocated as needed. Freeing meshes leaves gaps, which
+// defragment closes up by copying the live ranges into a new buffer with
+// glCopyNamedBufferSubData. That changes the buffer name and offsets, so
+// look ranges up with range each time rather than keeping them.
+//
+// All calls make OpenGL calls so must be made on the thread which owns the
+// context.
+class MeshBuffer {
+  public:
+    using Handle = std::uint32_t;
+    static constexpr Handle INVALID = static_cast<Handle>(-1);
+
+    struct Range {
+        GLuint buffer{0};
+        GLsizei first{0}; // In elements, for base vertex or first index
+        GLsizei count{0};
+        std::size_t page{0};
+    };
+
+    MeshBuffer(GLsizei element_size, GLsizei page_elements);
+
+    // A range for count elements, filled from p_data if given. Throws if
+    // count is bigger than a page.
+    Handle allocate(GLsizei count, const void* p_data = nullptr);
+    void free(Handle handle);
+
+    // Replace count elements starting first elements into the range
+    void upload(Handle handle, const void* p_data, GLsizei first,
+            GLsizei count) const;
+
+    Range range(Handle handle) const noexcept;
+
+    // Byte offset for glVertexArrayVertexBuffer and friends
+    GLintptr byte_offset(Handle handle) const noexcept {
+        return static_cast<GLintptr>(range(handle).first) * element_size_;
+    }
+
+    // Compact the most fragmented page if it is worse than threshold, see
+    // RangeAllocator::fragmentation. Returns whether a page was compacted.
+    bool defragment(float threshold = 0.5f);
+    void defragment_page(std::size_t page);
+
+    std::size_t pages() const noexcept {
+        return pages_.size();
+    }
+    GLuint page_name(std::size_t page) const noexcept {
+        return pages_[page].buffer.name();
+    }
+    const RangeAllocator& page_allocator(std::size_t page) const noexcept {
+        return pages_[page].allocator;
+    }
+    GLsizei element_size() const noexcept {
+        return element_size_;
+    }
+
+  private:
+    using Buffer = GL::GenericObject<GL::BUFFER_CLASS_TEMPLATE>;
+
+    struct Page {
+        Buffer buffer;
+        RangeAllocator allocator;
+    };
+    struct Slot {
+        std::size_t page{0};
+        std::size_t first{0};
+        std::size_t count{0}; // 0 when the handle is free
+    };
+
+    GLsizei element_size_;
+    GLsizei page_elements_;
+    std::vector<Page> pages_;
+    std::vector<Slot> slots_;
+    std::vector<Handle> free_handles_;
+
+    Buffer create_buffer() const;
+};
+
+} // namespace Greenbell
+#endif
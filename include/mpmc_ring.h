@@ -0,0 +1,109 @@
+// Bounded lock free queue for any number of producers and consumers
+#ifndef GB_MPMC_RING_H
+#define GB_MPMC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace Greenbell {
+
+// Based on Dmitry Vyukov's bounded MPMC queue. Every cell has a sequence
+// number which says whether it is ready to be written or read for a given
+// lap around the ring, so producers and consumers only contend on a single
+// compare and swap of their own position counter. Never blocks: pushing to
+// a full ring or popping from an empty one fails instead.
+template <typename T>
+class MPMCRing {
+  public:
+    // Capacity is rounded up to a power of 2
+    explicit MPMCRing(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+        p_cells_ = std::make_unique<Cell[]>(size);
+        mask_ = size - 1;
+        for (std::size_t i = 0; i < size; ++i) {
+            p_cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // No copies or moves
+    MPMCRing(const MPMCRing&) = delete;
+    MPMCRing& operator=(const MPMCRing&) = delete;
+    MPMCRing(MPMCRing&&) = delete;
+    MPMCRing& operator=(MPMCRing&&) = delete;
+    ~MPMCRing() = default;
+
+    std::size_t capacity() const noexcept {
+        return mask_ + 1;
+    }
+
+    // Value is only moved from if the push succeeds
+    bool try_push(T& value) noexcept {
+        Cell* p_cell = nullptr;
+        auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            p_cell = &p_cells_[pos & mask_];
+            const auto seq = p_cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(seq) -
+                    static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                        std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        p_cell->value = std::move(value);
+        p_cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& value) noexcept {
+        Cell* p_cell = nullptr;
+        auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            p_cell = &p_cells_[pos & mask_];
+            const auto seq = p_cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(seq) -
+                    static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                        std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Empty
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(p_cell->value);
+        p_cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+  private:
+    // A 64 byte T such as Job makes each cell two cache lines, which still
+    // keeps neighbouring cells from sharing one
+    struct alignas(64) Cell {
+        std::atomic<std::size_t> sequence{0};
+        T value{};
+    };
+
+    std::unique_ptr<Cell[]> p_cells_;
+    std::size_t mask_{0};
+
+    // Separate cache lines so producers and consumers don't share one
+    alignas(64) std::atomic<std::size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<std::size_t> dequeue_pos_{0};
+};
+
+} // namespace Greenbell
+#endif
@@ -0,0 +1,116 @@
+// Everything a draw needs set, created once and bound as one object
+#ifndef GB_PIPELINE_STATE_H
+#define GB_PIPELINE_STATE_H
+
+#include "gl.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+
+namespace Greenbell {
+
+// The defaults match what Window sets up
+struct PipelineDesc {
+    GLuint program{0};
+    GLuint vao{0}; // Holds the vertex format and buffers
+
+    // Raster
+    GLenum cull_face{GL_NONE}; // GL_NONE for no culling, or GL_BACK etc.
+    GLenum polygon_mode{GL_FILL};
+
+    // Depth
+    bool depth_test{true};
+    bool depth_write{true};
+    GLenum depth_func{GL_LESS};
+
+    // Blend, the factors and equation are only used if enabled
+    bool blend{false};
+    GLenum blend_source{GL_SRC_ALPHA};
+    GLenum blend_destination{GL_ONE_MINUS_SRC_ALPHA};
+    GLenum blend_equation{GL_FUNC_ADD};
+
+    bool operator==(const PipelineDesc& other) const noexcept;
+    bool operator!=(const PipelineDesc& other) const noexcept {
+        return !(*this == other);
+    }
+    std::uint64_t hash() const noexcept;
+};
+
+// An immutable set of program, VAO, raster, depth and blend state. Binding
+// goes through GL::State, so only what differs from the state already set,
+// normally by the previous pipeline, reaches OpenGL. Passes which all use
+// pipelines can't leave anything dirty for each other, and nothing needs
+// setting defensively.
+//
+// Pipelines are made by a PipelineCache, so each distinct description only
+// exists once and can be compared by address or id.
+class PipelineState {
+  public:
+    const PipelineDesc& desc() const noexcept {
+        return desc_;
+    }
+    std::uint64_t hash() const noexcept {
+        return hash_;
+    }
+    // Creation order within the cache, which fits DrawBatcher's state
+    std::uint16_t id() const noexcept {
+        return id_;
+    }
+
+    // Sorting draws by this key orders them so the most expensive state
+    // changes least: the program in the top 16 bits, then blend, depth,
+    // cull and polygon mode packed as small indices, with the VAO, the
+    // cheapest, in the bottom 16 bits. Blend off sorts before blend on. It
+    // only groups draws. Names wider than their field can collide, so equal
+    // keys don't mean equal state. Binding still compares real values.
+    std::uint64_t sort_key() const noexcept {
+        return sort_key_;
+    }
+    bool operator<(const PipelineState& other) const noexcept {
+        return sort_key_ < other.sort_key_;
+    }
+
+    // Must be called on the thread which owns the context
+    void bind() const noexcept;
+
+  private:
+    friend class PipelineCache;
+    PipelineState(const PipelineDesc& desc, std::uint16_t id) noexcept;
+
+    PipelineDesc desc_;
+    std::uint64_t hash_;
+    std::uint64_t sort_key_;
+    std::uint16_t id_;
+};
+
+// Owns the pipelines, which stay valid until the cache is destroyed
+class PipelineCache {
+  public:
+    static constexpr std::size_t MAX_PIPELINES = 1 << 16;
+
+    PipelineCache() = default;
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+    PipelineCache(PipelineCache&&) = default;
+    PipelineCache& operator=(PipelineCache&&) = default;
+    ~PipelineCache() = default;
+
+    // The pipeline for a description, made the first time it is asked for.
+    // Throws if there would be more than MAX_PIPELINES.
+    const PipelineState& get(const PipelineDesc& desc);
+
+    const PipelineState& operator[](std::uint16_t id) const noexcept {
+        return pipelines_[id];
+    }
+    std::size_t size() const noexcept {
+        return pipelines_.size();
+    }
+
+  private:
+    std::deque<PipelineState> pipelines_; // Never moves them
+    std::unordered_multimap<std::uint64_t, std::uint16_t> by_hash_;
+};
+
+} // namespace Greenbell
+#endif
@@ -0,0 +1,85 @@
+// A namespace for CPU profiling with scoped zones
+#ifndef GB_PROFILER_H
+#define GB_PROFILER_H
+
+#include "cmake_config.h" /* ENABLE_PROFILER */
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace Greenbell::Profiler {
+
+// Zones are recorded into a ring buffer per thread so recording never locks
+// or allocates, apart from creating the thread's buffer the first time. When
+// a ring is full the oldest zones are overwritten. Nothing is recorded until
+// Start is called and a recording zone costs two clock reads.
+//
+// Use the GB_PROFILE macros below rather than calling these directly so
+// that profiling can be compiled out with the ENABLE_PROFILER cmake option.
+
+using Clock = std::chrono::steady_clock;
+
+// Set by Start and Stop
+inline std::atomic<bool> enabled_{false};
+
+inline bool Enabled() noexcept {
+    return enabled_.load(std::memory_order_relaxed);
+}
+
+// Start recording. Zones recorded before this are forgotten.
+void Start();
+void Stop();
+
+// Name shown for the calling thread
+void SetThreadName(std::string name);
+
+// Record a zone which has already finished. The name must be a string
+// literal or otherwise live until the trace has been written.
+void Record(const char* name, Clock::time_point start,
+        Clock::time_point end) noexcept;
+
+// Write every zone still in the buffers as Chrome trace event JSON, which
+// can be opened with Perfetto or chrome://tracing. Safe to call while other
+// threads are recording. Returns the number of zones written and throws if
+// the file can't be written.
+std::size_t WriteChromeTrace(const std::string& path);
+
+// Records a zone from construction until destruction
+class Zone {
+  public:
+    explicit Zone(const char* name) noexcept
+            : name_{Enabled() ? name : nullptr} {
+        if (name_) start_ = Clock::now();
+    }
+    ~Zone() {
+        if (name_) Record(name_, start_, Clock::now());
+    }
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+    Zone(Zone&&) = delete;
+    Zone& operator=(Zone&&) = delete;
+
+  private:
+    const char* name_;
+    Clock::time_point start_{};
+};
+
+} // namespace Greenbell::Profiler
+
+#ifdef ENABLE_PROFILER /* From cmake_config.h */
+#define GB_PROFILE_CONCAT_(a, b) a##b
+#define GB_PROFILE_CONCAT(a, b) GB_PROFILE_CONCAT_(a, b)
+// Time the rest of the enclosing scope
+#define GB_PROFILE_ZONE(name) \
+    ::Greenbell::Profiler::Zone GB_PROFILE_CONCAT(gb_zone_, __LINE__){name}
+#define GB_PROFILE_RECORD(name, start, end) \
+    ::Greenbell::Profiler::Record(name, start, end)
+#define GB_PROFILE_THREAD(name) ::Greenbell::Profiler::SetThreadName(name)
+#else
+#define GB_PROFILE_ZONE(name) static_cast<void>(0)
+#define GB_PROFILE_RECORD(name, start, end) static_cast<void>(0)
+#define GB_PROFILE_THREAD(name) static_cast<void>(0)
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+// A namespace for caching linked shader program binaries on disk
+#ifndef GB_PROGRAM_CACHE_H
+#define GB_PROGRAM_CACHE_H
+
+#include "glad.h"
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+namespace Greenbell::ProgramCache {
+
+// Programs are saved with glGetProgramBinary, one file per program named
+// after its key. The key is a hash of the shader sources together with the
+// GL vendor, renderer and version strings, so a driver update or different
+// GPU misses rather than loading a binary which doesn't match. Drivers can
+// still reject a binary, in which case it is compiled as normal and the file
+// replaced.
+//
+// Files are written under a temporary name and renamed into place, so
+// several processes sharing the directory never see half written files.
+//
+// The cache is off until SetDirectory is called. Key, Load and Store make
+// OpenGL calls so must be called on the thread which owns the context.
+
+struct Stats {
+    std::uint64_t hits{0};
+    std::uint64_t misses{0};
+    std::uint64_t rejected{0}; // Found on disk but the driver refused it
+    std::chrono::microseconds load_time{0};
+    // Time the cached programs originally took to compile, less the time to
+    // load them
+    std::chrono::microseconds time_saved{0};
+};
+
+// The directory must already exist. An empty path turns the cache off.
+// Logs the stats for the previous directory, then starts them again.
+void SetDirectory(std::string path);
+bool Enabled();
+
+// Key for a program built from the sources, in the order given
+std::uint64_t Key(std::initializer_list<std::string_view> sources);
+
+// Replace the program with the cached binary. Returns false, leaving the
+// program unlinked, if there isn't one or the driver rejects it.
+bool Load(GLuint pid, std::uint64_t key);
+
+// Save a linked program. It should have been linked with
+// GL_PROGRAM_BINARY_RETRIEVABLE_HINT set. compile_time is how long building
+// it took, which is what a later hit saves.
+void Store(GLuint pid, std::uint64_t key,
+        std::chrono::microseconds compile_time);
+
+Stats GetStats();
+
+// Write the hit rate and time saved to the log. Window does this after the
+// first frame, by when the programs needed at startup have been built.
+void LogStats();
+
+} // namespace Greenbell::ProgramCache
+#endif
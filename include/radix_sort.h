@@ -0,0 +1,23 @@
+// Sorting for large arrays of 64 bit keys, such as draw lists
+#ifndef GB_RADIX_SORT_H
+#define GB_RADIX_SORT_H
+
+#include <cstdint>
+#include <vector>
+
+namespace Greenbell {
+
+// A key and whatever it is the key for, usually an index into another array
+struct SortItem {
+    std::uint64_t key;
+    std::uint32_t index;
+};
+
+// Stable least significant digit radix sort, a byte at a time. Bytes which
+// are the same in every key are skipped, so keys which only use their low
+// bits cost fewer passes. scratch is resized to match and can be kept
+// between calls to avoid allocating.
+void RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch);
+
+} // namespace Greenbell
+#endif
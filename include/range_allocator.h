@@ -0,0 +1,57 @@
+// Hands out ranges of a fixed size space, such as part of a GPU buffer
+#ifndef GB_RANGE_ALLOCATOR_H
+#define GB_RANGE_ALLOCATOR_H
+
+#include <cstddef>
+#include <map>
+
+namespace Greenbell {
+
+// Best fit from a free list kept both by offset, so freed ranges merge with
+// their neighbours, and by size, so finding the best fit is a lookup. Units
+// are up to the caller, bytes or whole elements. Nothing is stored in the
+// space being managed, so it works for memory the CPU can't see.
+class RangeAllocator {
+  public:
+    static constexpr std::size_t NONE = static_cast<std::size_t>(-1);
+
+    explicit RangeAllocator(std::size_t capacity = 0);
+
+    // Offset of the new range, or NONE if there is no gap big enough.
+    // Alignment must be a power of 2.
+    std::size_t allocate(std::size_t size, std::size_t alignment = 1);
+
+    // Give back a range from allocate, with the same size
+    void free(std::size_t offset, std::size_t size);
+
+    // Forget every allocation
+    void reset();
+
+    std::size_t capacity() const noexcept {
+        return capacity_;
+    }
+    std::size_t free_space() const noexcept {
+        return free_space_;
+    }
+    std::size_t largest_free() const noexcept {
+        return by_size_.empty() ? 0 : by_size_.rbegin()->first;
+    }
+    std::size_t free_ranges() const noexcept {
+        return by_offset_.size();
+    }
+    // 0 when all the free space is in one range, nearing 1 as it is split
+    // into many small ones
+    float fragmentation() const noexcept;
+
+  private:
+    std::size_t capacity_;
+    std::size_t free_space_;
+    std::map<std::size_t, std::size_t> by_offset_;   // Offset to size
+    std::multimap<std::size_t, std::size_t> by_size_; // Size to offset
+
+    void insert(std::size_t offset, std::size_t size);
+    void erase(std::map<std::size_t, std::size_t>::iterator it);
+};
+
+} // namespace Greenbell
+#endif
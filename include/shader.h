@@ -2,10 +2,21 @@
 #define GB_SHADER_H
 
 #include "gl.h"
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
 #include <string_view>
+#include <vector>
 
 namespace Greenbell::Shader {
 
+// First line of every generated shader
+inline constexpr std::string_view GLSL_VERSION = "#version 450 core\n";
+
+// The Build functions load the program from ProgramCache instead of
+// compiling when the cache is enabled and has it, and store it otherwise.
+// Once linked the program is reflected, see shader_reflection.h.
+
 // Build a program from two string based shaders
 void Build(GLuint pid, std::string_view vertex_source,
         std::string_view fragment_source);
@@ -25,6 +36,79 @@ void BuildCompute(GLuint pid, std::string_view source);
 void PrintShaderLog(GLuint shader_id);
 void PrintProgramLog(GLuint pid);
 
+// Result of a program added to a Batch, which becomes ready once the driver
+// has finished building it
+class Future {
+  public:
+    Future() = default;
+
+    bool valid() const noexcept {
+        return static_cast<bool>(p_state_);
+    }
+    // Whether the build has finished, successfully or not. Never waits.
+    bool ready() const noexcept;
+    bool failed() const noexcept;
+    // Finish the build, waiting for the driver if needed, and throw if it
+    // failed
+    void get() const;
+
+  private:
+    friend class Batch;
+    struct State;
+    std::shared_ptr<State> p_state_;
+};
+
+// Builds several programs without waiting for each one in turn. Build
+// checks the compile and link status straight after each call, which makes
+// the driver finish each shader before the next is started. Batch issues
+// every compile and link first and only checks the results once the driver
+// reports they are complete, which lets drivers with
+// GL_KHR_parallel_shader_compile build them on several threads while the
+// caller carries on rendering.
+//
+// Without the extension completion can't be checked without waiting, so
+// poll finishes one program per call to spread the cost over frames.
+//
+// All calls make OpenGL calls so must be made on the thread which owns the
+// context. Programs must not be deleted while they are pending.
+class Batch {
+  public:
+    Batch();
+    ~Batch();
+
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+    Batch(Batch&&) = default;
+    Batch& operator=(Batch&& source); // Finishes what this had pending
+
+    // Same as Build and BuildCompute, but don't wait. The sources are
+    // copied by OpenGL so don't need to outlive the call.
+    Future add(GLuint pid, std::string_view vertex_source,
+            std::string_view fragment_source);
+    Future add_compute(GLuint pid, std::string_view source);
+
+    // Finish any programs which are complete. Returns how many are still
+    // pending. Failures are logged, and thrown by Future::get.
+    std::size_t poll();
+
+    // Finish every program, waiting for the driver
+    void wait();
+
+    std::size_t pending() const noexcept {
+        return pending_.size();
+    }
+
+    // Whether the driver supports GL_KHR_parallel_shader_compile or
+    // GL_ARB_parallel_shader_compile
+    static bool Parallel();
+
+  private:
+    std::vector<std::shared_ptr<Future::State>> pending_;
+
+    Future issue(GLuint pid, std::initializer_list<std::string_view> sources,
+            std::initializer_list<GLenum> types);
+};
+
 } // namespace Greenbell::Shader
 
 #endif
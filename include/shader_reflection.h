@@ -0,0 +1,128 @@
+// Uniforms and uniform blocks of linked programs, looked up by hashed name
+#ifndef GB_SHADER_REFLECTION_H
+#define GB_SHADER_REFLECTION_H
+
+#include "glad.h"
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Greenbell::Shader {
+
+// FNV-1a, so names can be hashed at compile time:
+//   constexpr auto MVP = Shader::NameHash("mvp");
+constexpr std::uint32_t NameHash(std::string_view name) noexcept {
+    std::uint32_t hash = 2166136261u;
+    for (const auto c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+struct UniformInfo {
+    std::string name; // Arrays are named without the "[0]"
+    std::uint32_t hash;
+    GLenum type;
+    GLint location;     // -1 for block members
+    GLint array_size;
+    GLint block;        // Index into Reflection::blocks, or -1
+    GLint offset;       // Bytes from the start of the block, or -1
+    GLint array_stride;
+    GLint matrix_stride;
+};
+
+struct BlockInfo {
+    std::string name;
+    std::uint32_t hash;
+    GLuint index;   // For glUniformBlockBinding
+    GLint binding;
+    GLint size;     // Bytes
+};
+
+// Everything the program reports through glGetProgramResourceiv. Names are
+// kept in flat open addressing tables by hash, so a lookup with a constant
+// hash is a few compares. Two names with the same hash are reported as an
+// error when the program is reflected.
+class Reflection {
+  public:
+    Reflection() = default;
+    explicit Reflection(GLuint pid); // Must be linked
+
+    const std::vector<UniformInfo>& uniforms() const noexcept {
+        return uniforms_;
+    }
+    const std::vector<BlockInfo>& blocks() const noexcept {
+        return blocks_;
+    }
+
+    // nullptr if the program has no such active uniform or block
+    const UniformInfo* uniform(std::uint32_t hash) const noexcept;
+    const BlockInfo* block(std::uint32_t hash) const noexcept;
+
+    // -1 if there is no such uniform, the same as glGetUniformLocation
+    GLint location(std::uint32_t hash) const noexcept {
+        const auto p_uniform = uniform(hash);
+        return p_uniform ? p_uniform->location : -1;
+    }
+    GLint location(std::string_view name) const noexcept {
+        return location(NameHash(name));
+    }
+
+  private:
+    // Index + 1 of the entry with each hash, 0 for empty
+    struct Slot {
+        std::uint32_t hash;
+        std::uint32_t index;
+    };
+
+    std::vector<UniformInfo> uniforms_;
+    std::vector<BlockInfo> blocks_;
+    std::vector<Slot> uniform_slots_;
+    std::vector<Slot> block_slots_;
+
+    template <typename T>
+    static std::vector<Slot> MakeTable(const std::vector<T>& entries);
+    static const Slot* Find(const std::vector<Slot>& table,
+            std::uint32_t hash) noexcept;
+};
+
+// Reflect a program which has just linked, replacing anything kept for the
+// id before, and check its uniform blocks against ExpectBlock. Throws if
+// any don't match. The Build functions and Batch call this themselves.
+void Reflect(GLuint pid);
+
+// What was found the last time the program was built. Empty if it hasn't
+// been. The pointer stays valid if the program is rebuilt or deleted.
+std::shared_ptr<const Reflection> GetReflection(GLuint pid);
+
+// Drop what was kept for a program which is being deleted, since OpenGL can
+// give its name to a new program. GL::ProgramObject calls this.
+void ForgetReflection(GLuint pid) noexcept;
+
+// A member of the C++ struct used to fill a uniform block
+struct BlockMember {
+    std::string_view name;
+    std::size_t offset;
+};
+#define GB_BLOCK_MEMBER(type, member) \
+    ::Greenbell::Shader::BlockMember{#member, offsetof(type, member)}
+
+// Declare the layout of the struct uploaded to a UBO binding point, such as
+// BINDPOINT_MATRICES. Any block a program binds there must have exactly
+// these members at these offsets, and be no bigger than size, or building
+// the program throws. This catches std140 padding mistakes when shaders
+// load rather than as garbage at draw time.
+//
+//   Shader::ExpectBlock(BINDPOINT_MATRICES, sizeof(Matrices), {
+//           GB_BLOCK_MEMBER(Matrices, projection),
+//           GB_BLOCK_MEMBER(Matrices, view)});
+void ExpectBlock(GLint binding, std::size_t size,
+        std::initializer_list<BlockMember> members);
+
+} // namespace Greenbell::Shader
+#endif
@@ -0,0 +1,97 @@
+// Programs built from one shader with different features switched on
+#ifndef GB_SHADER_VARIANTS_H
+#define GB_SHADER_VARIANTS_H
+
+#include "gl.h"
+#include "shader.h"
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Greenbell {
+
+// Bit i of a key switches on feature i
+using VariantKey = std::uint32_t;
+inline constexpr std::size_t MAX_VARIANT_FEATURES = 32;
+
+constexpr VariantKey VariantBit(std::size_t feature) noexcept {
+    return VariantKey{1} << feature;
+}
+
+// Each variant is the same source with a "#define NAME 1" line for every
+// feature in its key, inserted after Shader::GLSL_VERSION, so the sources
+// must not have a #version line of their own. Features are usually declared
+// as an enum so keys are constants:
+//
+//   enum : VariantKey { SKINNED = VariantBit(0), NORMAL_MAP = VariantBit(1) };
+//   ShaderVariants pbr{vs, fs, {"SKINNED", "NORMAL_MAP"}};
+//   pbr.get(SKINNED | NORMAL_MAP).use();
+//
+// A variant is built the first time get asks for it, which waits for the
+// driver. prewarm starts building a list of variants up front without
+// waiting, so poll can finish them while the game keeps running.
+//
+// All calls make OpenGL calls so must be made on the thread which owns the
+// context.
+class ShaderVariants {
+  public:
+    ShaderVariants(std::string vertex_source, std::string fragment_source,
+            std::initializer_list<std::string_view> features);
+    // For compute shaders
+    ShaderVariants(std::string compute_source,
+            std::initializer_list<std::string_view> features);
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+    ShaderVariants(ShaderVariants&&) = default;
+    ShaderVariants& operator=(ShaderVariants&&) = default;
+    ~ShaderVariants() = default;
+
+    // The program for a variant, building it first if needed. Throws if
+    // the key has bits for undeclared features or the build fails.
+    const GL::ProgramObject& get(VariantKey key);
+
+    // Whether get would return without waiting
+    bool ready(VariantKey key) const;
+
+    // Start building the variants which haven't been already, or which
+    // failed
+    void prewarm(std::initializer_list<VariantKey> keys);
+    void prewarm(const std::vector<VariantKey>& keys);
+
+    // Finish any prewarmed variants which are complete. Returns how many
+    // are still being built.
+    std::size_t poll() {
+        return batch_.poll();
+    }
+
+    // The lines inserted for a variant
+    std::string defines(VariantKey key) const;
+
+    // Number of variants built or being built
+    std::size_t size() const noexcept {
+        return programs_.size();
+    }
+
+  private:
+    struct Variant {
+        GL::ProgramObject program;
+        Shader::Future future;
+    };
+
+    std::vector<std::string> sources_; // Vertex and fragment, or compute
+    std::vector<std::string> features_;
+    std::unordered_map<VariantKey, Variant> programs_;
+    Shader::Batch batch_;
+
+    std::string source(std::size_t index, VariantKey key) const;
+    void prewarm_one(VariantKey key);
+    Variant& start(VariantKey key);
+};
+
+} // namespace Greenbell
+#endif
@@ -0,0 +1,114 @@
+// A persistently mapped buffer for data written every frame
+#ifndef GB_STREAM_BUFFER_H
+#define GB_STREAM_BUFFER_H
+
+#include "gl.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace Greenbell {
+
+// The buffer is created once with glNamedBufferStorage and stays mapped, so
+// writes go straight to memory the GPU reads from. Unlike glNamedBufferData
+// there is no reallocation and no copy by the driver. It is split into one
+// region per frame in flight. Each frame allocates from its region, and
+// end_frame places a fence after the frame's commands. A region is only
+// reused once the GPU has passed its fence, which begin_frame waits for if
+// it has to.
+//
+// Allocations are only valid until the end of the frame. Since the mapping
+// is coherent, nothing needs flushing, but the draws using an allocation
+// must be issued before end_frame.
+//
+// All calls make OpenGL calls so must be made on the thread which owns the
+// context, apart from writing through Allocation::p_data.
+class StreamBuffer {
+  public:
+    struct Allocation {
+        void* p_data{nullptr};
+        GLintptr offset{0}; // From the start of the buffer
+        GLsizeiptr size{0};
+
+        explicit operator bool() const noexcept {
+            return p_data;
+        }
+    };
+
+    explicit StreamBuffer(GLsizeiptr region_size, std::size_t regions = 3);
+    ~StreamBuffer();
+
+    // No copies, and no moves since allocations point into the mapping
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+    StreamBuffer(StreamBuffer&&) = delete;
+    StreamBuffer& operator=(StreamBuffer&&) = delete;
+
+    // Every begin_frame must be matched by end_frame
+    void begin_frame();
+    void end_frame();
+
+    // Returns an empty allocation if the region is full. Alignment must be
+    // a power of 2.
+    Allocation allocate(GLsizeiptr size, GLsizeiptr alignment = 4) noexcept;
+
+    // Aligned for binding with glBindBufferRange(GL_UNIFORM_BUFFER, ...)
+    Allocation allocate_uniform(GLsizeiptr size) noexcept {
+        return allocate(size, uniform_alignment_);
+    }
+
+    // Copy an array in, for example vertices or GL::DEIC commands
+    template <typename T>
+    Allocation write(const T* p_source, std::size_t count,
+            GLsizeiptr alignment = alignof(T)) noexcept {
+        const auto ret = allocate(static_cast<GLsizeiptr>(sizeof(T) * count),
+                alignment);
+        if (ret) std::memcpy(ret.p_data, p_source, sizeof(T) * count);
+        return ret;
+    }
+
+    GLuint name() const noexcept {
+        return buffer_.name();
+    }
+    GLsizeiptr region_size() const noexcept {
+        return region_size_;
+    }
+    // Bytes allocated so far this frame, including padding
+    GLsizeiptr used() const noexcept {
+        return head_ - region_start();
+    }
+
+    // Frames which had to wait for the GPU, and the total time waited
+    std::uint64_t stalls() const noexcept {
+        return stalls_;
+    }
+    std::chrono::microseconds stall_time() const noexcept {
+        return stall_time_;
+    }
+    // Allocations which didn't fit
+    std::uint64_t overflows() const noexcept {
+        return overflows_;
+    }
+
+  private:
+    GL::GenericObject<GL::BUFFER_CLASS_TEMPLATE> buffer_;
+    std::byte* p_mapping_{nullptr};
+    GLsizeiptr region_size_;
+    GLsizeiptr uniform_alignment_{256};
+    std::vector<GLsync> fences_;
+    std::size_t region_{0};
+    GLsizeiptr head_{0};
+
+    std::uint64_t stalls_{0};
+    std::chrono::microseconds stall_time_{0};
+    std::uint64_t overflows_{0};
+
+    GLsizeiptr region_start() const noexcept {
+        return region_size_ * static_cast<GLsizeiptr>(region_);
+    }
+};
+
+} // namespace Greenbell
+#endif
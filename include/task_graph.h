@@ -0,0 +1,122 @@
+// Jobs with dependencies, for running the stages of a frame on a ThreadPool
+#ifndef GB_TASK_GRAPH_H
+#define GB_TASK_GRAPH_H
+
+#include "job.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace Greenbell {
+
+// A graph is built once by adding tasks and the order between them, then
+// run as many times as needed. Each task is dispatched as soon as all of its
+// predecessors have finished. Running never allocates once the graph has been
+// run the first time (or after it was last changed).
+//
+// Each run is timed so the critical path, the longest chain of dependent
+// tasks, can be reported. No amount of extra cores can make a run faster
+// than that.
+class TaskGraph {
+  public:
+    using TaskId = std::size_t;
+    using Duration = std::chrono::microseconds;
+
+    TaskGraph() = default;
+    ~TaskGraph() = default;
+
+    // No copies or moves since running jobs point at the graph
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+    TaskGraph(TaskGraph&&) = delete;
+    TaskGraph& operator=(TaskGraph&&) = delete;
+
+    // Add a task which may run once every predecessor has finished. The name
+    // must be a string literal or otherwise outlive the graph.
+    template <typename F>
+    TaskId add(const char* name, F&& fn,
+            std::initializer_list<TaskId> predecessors = {}) {
+        tasks_.push_back(Task{name, Job{std::forward<F>(fn)}});
+        compiled_ = false;
+        const auto id = tasks_.size() - 1;
+        for (const auto before : predecessors) precede(before, id);
+        return id;
+    }
+
+    // Make "after" wait for "before" to finish. Throws on an unknown task.
+    void precede(TaskId before, TaskId after);
+
+    // Run every task on the pool and return when all have finished. The
+    // calling thread runs tasks while it waits. Throws if the tasks have a
+    // dependency cycle. Must not be called again until it has returned.
+    // Jobs dispatched from inside the tasks inherit the priority.
+    void run(ThreadPool& pool, JobPriority priority = JobPriority::NORMAL);
+
+    std::size_t size() const noexcept {
+        return tasks_.size();
+    }
+    const char* name(TaskId id) const noexcept {
+        return tasks_[id].name;
+    }
+
+    // Timing from the last run
+    Duration duration(TaskId id) const noexcept {
+        return std::chrono::duration_cast<Duration>(
+                tasks_[id].end - tasks_[id].start);
+    }
+    Duration wall_time() const noexcept {
+        return std::chrono::duration_cast<Duration>(run_end_ - run_start_);
+    }
+    Duration critical_path() const noexcept {
+        return critical_length_;
+    }
+    // Tasks on the critical path from first to last
+    const std::vector<TaskId>& critical_path_tasks() const noexcept {
+        return critical_tasks_;
+    }
+
+  private:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    struct Task {
+        const char* name;
+        Job job;
+        TimePoint start{};
+        TimePoint end{};
+    };
+
+    std::vector<Task> tasks_;
+    std::vector<std::pair<TaskId, TaskId>> edges_;
+    bool compiled_{false};
+
+    // Built by compile: successors of each task as one flat array indexed
+    // by successor_begin_, predecessor counts and a topological order
+    std::vector<TaskId> successors_;
+    std::vector<std::size_t> successor_begin_;
+    std::vector<std::size_t> predecessor_count_;
+    std::vector<TaskId> order_;
+    std::unique_ptr<std::atomic<std::size_t>[]> remaining_;
+
+    // Critical path working space and results
+    std::vector<Duration> path_length_;
+    std::vector<TaskId> path_previous_;
+    std::vector<TaskId> critical_tasks_;
+    Duration critical_length_{0};
+
+    ThreadPool* p_pool_{nullptr};
+    JobGroup group_;
+    TimePoint run_start_{};
+    TimePoint run_end_{};
+
+    void compile();
+    void run_task(TaskId id);
+    void find_critical_path();
+};
+
+} // namespace Greenbell
+#endif
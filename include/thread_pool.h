@@ -1,23 +1,86 @@
 #ifndef GB_THREAD_POOL_H
 #define GB_THREAD_POOL_H
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <thread>
-#include <functional>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <condition_variable>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#include "job.h"
+#include "mpmc_ring.h"
 
 namespace Greenbell {
 
+// Counts jobs which have been dispatched but not finished. Dispatch jobs with
+// ThreadPool::dispatch(group, job) and then ThreadPool::wait(group) runs queued
+// jobs until every job in the group has finished. A group may be reused once
+// it has finished.
+class JobGroup {
+  public:
+    JobGroup() noexcept = default;
+    ~JobGroup() = default;
+
+    // No copies or moves since running jobs point at the group
+    JobGroup(const JobGroup&) = delete;
+    JobGroup& operator=(const JobGroup&) = delete;
+    JobGroup(JobGroup&&) = delete;
+    JobGroup& operator=(JobGroup&&) = delete;
+
+    void add(std::size_t count = 1) noexcept {
+        count_.fetch_add(count, std::memory_order_relaxed);
+    }
+    void done() noexcept {
+        count_.fetch_sub(1, std::memory_order_release);
+    }
+    bool finished() const noexcept {
+        return count_.load(std::memory_order_acquire) == 0;
+    }
+
+  private:
+    std::atomic<std::size_t> count_{0};
+};
+
+template <typename R>
+class JobFuture; // Forward reference
+
+// Queue design chosen when a ThreadPool is constructed
+// WORK_STEALING = Per worker deques, best when jobs spawn more jobs
+// MPMC_RING = One bounded lock free ring shared by every worker. Idle workers
+//      spin briefly before parking so a steady stream of dispatches rarely
+//      needs a mutex or a futex wake. Best for many producer threads.
+enum class PoolQueue { WORK_STEALING, MPMC_RING };
+
+// Each priority has its own lane of queues and workers always take from the
+// highest priority lane that has work, except that background jobs get a
+// turn every so often so they can't be starved forever.
+// FRAME = Must finish this frame, such as culling and animation
+// NORMAL = Default for dispatch
+// BACKGROUND = Streaming, asset decoding, shader builds, etc.
+enum class JobPriority { FRAME, NORMAL, BACKGROUND };
+
+// Work stealing thread pool. Each worker owns a deque of jobs. Jobs
+// dispatched from outside the pool are spread round robin over the worker
+// deques, jobs dispatched from inside a worker can go straight onto that
+// worker's own deque. A worker runs its own jobs newest first and when it
+// runs out it steals the oldest jobs from its siblings.
 class ThreadPool {
     // Jobs are "void func(void)" but may consume parameters via lambda capture
-    // or std::bind
-    using job_t = std::function<void(void)>;
+    // or std::bind. Captures are stored inline in the Job (see job.h) so
+    // dispatching never allocates.
+    using job_t = Job;
 
   public:
-    ThreadPool(std::size_t thread_count = 1);
+    ThreadPool(std::size_t thread_count = 1,
+            PoolQueue queue = PoolQueue::WORK_STEALING);
     ~ThreadPool();
 
     // No copies or moves
@@ -26,19 +89,291 @@ class ThreadPool {
     ThreadPool(ThreadPool&& rhs) = delete;
     ThreadPool& operator=(ThreadPool&& rhs) = delete;
 
-    // Dispatch has "copy job" and "move job" versions
-    void dispatch(const job_t& op);
-    void dispatch(job_t&& op);
+    // Dispatch takes anything that can be made into a job, such as a lambda,
+    // and builds the job in place. Priority is JobPriority::NORMAL unless
+    // given.
+    template <typename F>
+    void dispatch(F&& op) {
+        dispatch(JobPriority::NORMAL, job_t{std::forward<F>(op)});
+    }
+    template <typename F>
+    void dispatch(JobPriority priority, F&& op) {
+        dispatch(priority, job_t{std::forward<F>(op)});
+    }
+    void dispatch(JobPriority priority, job_t&& op);
+
+    // Push a job onto the deque of the calling worker thread. This avoids
+    // touching any other worker's deque so is the cheapest way for a job to
+    // spawn more jobs. If not called from a worker of this pool, or if the
+    // pool uses PoolQueue::MPMC_RING, it is the same as dispatch. The job
+    // gets the priority of the job calling this, or NORMAL if there isn't
+    // one.
+    template <typename F>
+    void dispatch_local(F&& op) {
+        dispatch_local(job_t{std::forward<F>(op)});
+    }
+    void dispatch_local(job_t&& op);
+
+    // Dispatch a job counted by a group so it can be waited on
+    template <typename F>
+    void dispatch(JobGroup& group, F&& op) {
+        dispatch(JobPriority::NORMAL, group, std::forward<F>(op));
+    }
+    template <typename F>
+    void dispatch(JobPriority priority, JobGroup& group, F&& op) {
+        group.add();
+        dispatch(priority, counted(group, std::forward<F>(op)));
+    }
+    template <typename F>
+    void dispatch_local(JobGroup& group, F&& op) {
+        group.add();
+        dispatch_local(counted(group, std::forward<F>(op)));
+    }
+
+    // Dispatch a job and get a future for its return value. This allocates
+    // once for the shared result so prefer dispatch with a JobGroup in hot
+    // code. Exceptions thrown by the job are rethrown by JobFuture::get.
+    template <typename F>
+    auto submit(F&& op) -> JobFuture<std::invoke_result_t<std::decay_t<F>&>> {
+        return submit(JobPriority::NORMAL, std::forward<F>(op));
+    }
+    template <typename F>
+    auto submit(JobPriority priority, F&& op)
+            -> JobFuture<std::invoke_result_t<std::decay_t<F>&>>;
+
+    // Limit how many threads may run background jobs at the same time, so
+    // the rest are always free for frame work. Zero means no limit, which is
+    // the default. Threads helping in wait count towards the limit too.
+    void set_background_limit(std::size_t limit) noexcept {
+        background_limit_ = limit;
+    }
+
+    // These run queued jobs on the calling thread while waiting rather than
+    // blocking, so the caller helps finish the work. wait_idle returns when
+    // nothing is queued or running. It counts the job calling it, so must
+    // not be called from inside a job, but waiting on a group is fine.
+    void wait(const JobGroup& group);
+    void wait_idle();
+
+    // Run one queued job on the calling thread. Returns false if there was
+    // nothing to run.
+    bool run_pending();
+
+    // Call fn(i) for every i in [begin, end) using the pool and the calling
+    // thread, returning when all calls have finished. The range is split in
+    // half recursively into roughly four chunks per worker, never smaller
+    // than grain elements. A chunk which gets stolen by an idle worker is
+    // allowed to split again, so uneven work still spreads out.
+    template <typename Index, typename F>
+    void parallel_for(Index begin, Index end, Index grain, F&& fn);
+
+    // Like parallel_for but returns combine(...combine(identity, fn(i))...)
+    // over the range. Chunks are combined in whatever order they finish so
+    // combine must be associative and commutative.
+    template <typename Index, typename T, typename F, typename C>
+    T parallel_reduce(Index begin, Index end, Index grain, T identity, F&& fn,
+            C&& combine);
+
+    // Number of worker threads
+    std::size_t size() const noexcept {
+        return workers_.size();
+    }
 
   private:
-    std::mutex mutex_;
-    std::queue<job_t> q_;
+    static constexpr std::size_t LANE_COUNT = 3; // One per JobPriority
+
+    struct Worker {
+        std::mutex mutex;
+        JobRing jobs[LANE_COUNT];
+        std::thread thread;
+    };
+
+    // Workers are not movable because of the mutex so they are held by
+    // pointer, but the vector itself never changes after construction
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<std::size_t> next_worker_{0}; // Round robin for dispatch
+
+    // Only used for PoolQueue::MPMC_RING. When the ring is full dispatch
+    // runs queued jobs until there is room.
+    static constexpr std::size_t RING_CAPACITY = 2048; // Per lane
+    static constexpr int RING_SPIN_LIMIT = 1024; // Polls before parking
+    std::unique_ptr<MPMCRing<job_t>> p_rings_[LANE_COUNT];
+
+    // A thread that has run this many higher priority jobs in a row while
+    // background jobs were waiting takes a background job next
+    static constexpr int BACKGROUND_STARVE_LIMIT = 16;
+    std::atomic<std::size_t> background_limit_{0};
+    std::atomic<std::size_t> background_running_{0};
+
+    // Idle workers park on the condition variable. Jobs queued but not yet
+    // started are counted per lane so dispatch only needs the mutex when there
+    // is actually a worker asleep.
+    std::atomic<std::int64_t> pending_[LANE_COUNT]{};
+    std::atomic<std::int64_t> sleepers_{0};
+    std::atomic<std::int64_t> outstanding_{0}; // Queued or running
+    std::atomic<bool> quit_{false};
+    std::mutex sleep_mutex_;
     std::condition_variable cv_;
-    std::vector<std::thread> threads_;
-    bool quit_ = false;
 
-    void thread_handler();
+    void push(std::size_t index, std::size_t lane, job_t&& op, bool local);
+    void wake_one();
+    bool runnable() const noexcept;
+    bool pop(std::size_t index, std::size_t lane, job_t& op);
+    bool steal(std::size_t first, std::size_t count, std::size_t lane,
+            job_t& op);
+    bool take(std::size_t index, std::size_t lane, job_t& op);
+    bool take(std::size_t index, job_t& op, std::size_t& lane);
+    void execute(job_t& op, std::size_t lane);
+    void thread_handler(std::size_t index);
+
+    // Index of the calling thread's worker or NOT_A_WORKER
+    static constexpr std::size_t NOT_A_WORKER = ~std::size_t{0};
+    std::size_t worker_index() const noexcept;
+
+    // Shared by all the jobs of one parallel_for, which lives on the stack of
+    // the thread waiting for them
+    template <typename Index, typename Body>
+    struct RangeContext {
+        ThreadPool* p_pool;
+        JobGroup group;
+        Body* p_body;
+        Index grain;
+    };
+    static constexpr int STOLEN_RANGE_DEPTH = 2;
+    int range_depth() const noexcept;
+    template <typename Index, typename Body>
+    void run_range(RangeContext<Index, Body>& ctx, Index begin, Index end,
+            int depth, std::size_t owner);
+
+    template <typename F>
+    static auto counted(JobGroup& group, F&& op) {
+        return [&group, op = std::forward<F>(op)]() mutable {
+            op();
+            group.done();
+        };
+    }
+};
+
+// Result of ThreadPool::submit. Small and movable, shares the result with the
+// job that produces it.
+template <typename R>
+class JobFuture {
+    struct State {
+        std::atomic<bool> ready{false};
+        std::optional<std::conditional_t<std::is_void_v<R>, bool, R>> value;
+        std::exception_ptr error;
+    };
+
+  public:
+    JobFuture() noexcept = default;
+
+    bool valid() const noexcept {
+        return p_state_ != nullptr;
+    }
+    bool ready() const noexcept {
+        return p_state_ && p_state_->ready.load(std::memory_order_acquire);
+    }
+
+    // Run queued jobs until this one has finished. Throws if the future is
+    // default constructed or moved from, like std::future.
+    void wait() const {
+        if (!valid()) throw std::logic_error("JobFuture: No shared state");
+        while (!ready()) {
+            if (!p_pool_->run_pending()) std::this_thread::yield();
+        }
+    }
+
+    // Wait and then return the result or rethrow the job's exception. The
+    // result is moved out so this can only be called once.
+    R get() {
+        wait();
+        if (p_state_->error) std::rethrow_exception(p_state_->error);
+        if constexpr (!std::is_void_v<R>) {
+            return std::move(*p_state_->value);
+        }
+    }
+
+  private:
+    friend class ThreadPool;
+    ThreadPool* p_pool_{nullptr};
+    std::shared_ptr<State> p_state_;
 };
 
+template <typename Index, typename Body>
+void ThreadPool::run_range(RangeContext<Index, Body>& ctx, Index begin,
+        Index end, int depth, std::size_t owner) {
+    const auto index = worker_index();
+    if (owner != index) depth = std::max(depth, STOLEN_RANGE_DEPTH);
+
+    // Keep the left half and offer the right half to other workers
+    while (depth > 0 && static_cast<Index>(end - begin) > ctx.grain) {
+        const auto mid = static_cast<Index>(begin + (end - begin) / 2);
+        --depth;
+        dispatch_local(ctx.group, [&ctx, mid, end, depth, index]() {
+            ctx.p_pool->run_range(ctx, mid, end, depth, index);
+        });
+        end = mid;
+    }
+    (*ctx.p_body)(begin, end);
+}
+
+template <typename Index, typename F>
+void ThreadPool::parallel_for(Index begin, Index end, Index grain, F&& fn) {
+    static_assert(std::is_integral_v<Index>, "Index must be an integer");
+    if (!(begin < end)) return;
+    auto body = [&fn](Index first, Index last) {
+        for (auto i = first; i < last; ++i) fn(i);
+    };
+    RangeContext<Index, decltype(body)> ctx{this, {}, &body,
+            std::max(grain, Index{1})};
+    run_range(ctx, begin, end, range_depth(), worker_index());
+    wait(ctx.group);
+}
+
+template <typename Index, typename T, typename F, typename C>
+T ThreadPool::parallel_reduce(Index begin, Index end, Index grain, T identity,
+        F&& fn, C&& combine) {
+    static_assert(std::is_integral_v<Index>, "Index must be an integer");
+    if (!(begin < end)) return identity;
+    T result = identity;
+    std::mutex mutex;
+    auto body = [&](Index first, Index last) {
+        T partial = identity;
+        for (auto i = first; i < last; ++i) {
+            partial = combine(std::move(partial), fn(i));
+        }
+        std::lock_guard<std::mutex> lock{mutex};
+        result = combine(std::move(result), std::move(partial));
+    };
+    RangeContext<Index, decltype(body)> ctx{this, {}, &body,
+            std::max(grain, Index{1})};
+    run_range(ctx, begin, end, range_depth(), worker_index());
+    wait(ctx.group);
+    return result;
+}
+
+template <typename F>
+auto ThreadPool::submit(JobPriority priority, F&& op)
+        -> JobFuture<std::invoke_result_t<std::decay_t<F>&>> {
+    using R = std::invoke_result_t<std::decay_t<F>&>;
+    JobFuture<R> future;
+    future.p_pool_ = this;
+    future.p_state_ = std::make_shared<typename JobFuture<R>::State>();
+    dispatch(priority, [p_state = future.p_state_,
+            op = std::forward<F>(op)]() mutable {
+        try {
+            if constexpr (std::is_void_v<R>) {
+                op();
+            } else {
+                p_state->value.emplace(op());
+            }
+        } catch (...) {
+            p_state->error = std::current_exception();
+        }
+        p_state->ready.store(true, std::memory_order_release);
+    });
+    return future;
+}
+
 } // namespace Greenbell
 #endif
@@ -3,9 +3,14 @@
 
 #include "SDL2/SDL_video.h"
 #include "gl.h"
+#include "command_buffer.h"
+#include "frame_stats.h"
+#include "job.h"
 #include <string>
 #include <chrono>
+#include <cstddef>
 #include <memory>
+#include <utility>
 
 namespace Greenbell {
 
@@ -37,6 +42,28 @@ inline constexpr auto LIMITER_300_FPS = std::chrono::microseconds(3333);
 inline constexpr auto LIMITER_400_FPS = std::chrono::microseconds(2500);
 inline constexpr auto LIMITER_500_FPS = std::chrono::microseconds(2000);
 
+// SLEEP just sleeps, which is cheap but can wake up late by anywhere from
+// 50us to 500us depending on the OS timer slack. HYBRID sleeps for most of
+// the wait and then spins on the clock for the last stretch. It learns how
+// late the OS wakes it up so it spins only as long as needed, but it does
+// keep a core busy while spinning.
+enum class FrameLimiter { SLEEP, HYBRID };
+
+// Returned by Window::end_frame. Converts to the frame duration so it can be
+// used wherever a plain duration was expected.
+struct FrameTiming {
+    // Time since start_frame not including the limiter
+    std::chrono::microseconds duration{0};
+    // Time since start_frame including the limiter, minus min_duration. Zero
+    // is perfect pacing, positive is late. Zero if the limiter is disabled.
+    std::chrono::microseconds pacing_error{0};
+    // How late the OS currently wakes up from a sleep, as learned by the
+    // HYBRID limiter
+    std::chrono::microseconds wake_overshoot{0};
+
+    operator std::chrono::microseconds() const noexcept { return duration; }
+};
+
 struct WindowInfo {
     std::string title{"Greenbell"};
     std::int32_t width{1280};
@@ -48,9 +75,26 @@ struct WindowInfo {
     std::int32_t msaa{0};
     std::int32_t ogl_major{OGL_MAJOR_DEFAULT};
     std::int32_t ogl_minor{OGL_MINOR_DEFAULT};
+    bool render_thread{false}; // See Window::commands
+    FrameLimiter limiter{FrameLimiter::SLEEP};
+};
+
+// Timing of the last frame handed to the render thread
+struct RenderThreadStats {
+    // From end_frame handing over the frame until the render thread started
+    // replaying it
+    std::chrono::microseconds handoff_latency{0};
+    // Time end_frame was blocked waiting for the render thread to take the
+    // frame, which is how long it was still busy with the frame before
+    std::chrono::microseconds main_wait{0};
+    std::chrono::microseconds replay_time{0};
+    std::chrono::microseconds swap_time{0};
+    std::size_t command_count{0};
+    double commands_per_second{0.0}; // Replay throughput
 };
 
 class SDLWindowWrapper; // Forward reference
+class RenderThread;     // Forward reference
 
 class Window {
   public:
@@ -70,13 +114,49 @@ class Window {
     void start_frame() const noexcept;
 
     // Call when finished rendering to swap the frame to output, invoke the
-    // soft frame limiter (if min_duration > 0), and return frame duration.
+    // soft frame limiter (if min_duration > 0), and return frame timing.
     // The return duration is the time since the previous call to start_frame
     // not including any delay by the soft frame limiter. However this will
-    // include the delay by vsync if it is enabled.
-    std::chrono::microseconds end_frame(
+    // include the delay by vsync if it is enabled. See FrameTiming for how
+    // close the limiter got to min_duration.
+    // With a render thread this hands the recorded commands over instead of
+    // swapping. It only waits if the render thread is still busy with the
+    // previous frame, so the next frame can be built while this one is
+    // being submitted.
+    FrameTiming end_frame(
             std::chrono::microseconds min_duration) const noexcept;
 
+    // Commands recorded for the current frame. These are replayed in order
+    // before the swap in end_frame. If WindowInfo::render_thread was set the
+    // OpenGL context belongs to a dedicated thread and EVERY OpenGL call,
+    // including creating and deleting objects, must be recorded here or made
+    // through render_sync. There are two buffers which take turns so that
+    // recording for frame N+1 overlaps replaying frame N. Any thread may
+    // record but all recording for a frame must be done before end_frame.
+    CommandBuffer& commands() const noexcept {
+        return command_buffers_[record_index_];
+    }
+
+    // Run a job on the thread which owns the OpenGL context and wait for it
+    // to finish, for loading resources and other work outside of frames.
+    // Exceptions from the job are rethrown here.
+    template <typename F>
+    void render_sync(F&& fn) const {
+        render_sync(Job{std::forward<F>(fn)});
+    }
+    void render_sync(Job&& job) const;
+
+    bool has_render_thread() const noexcept {
+        return ps_render_ != nullptr;
+    }
+    RenderThreadStats render_stats() const noexcept;
+
+    // Rolling statistics of the recent frames, which can be read from any
+    // thread while frames are running
+    const FrameStats& frame_stats() const noexcept {
+        return frame_stats_;
+    }
+
     // Get information about the window
     float aspect_ratio() const noexcept;
     int32_t width() const noexcept {return win_info_.width;}
@@ -86,8 +166,17 @@ class Window {
 
   protected:
     mutable std::chrono::time_point<std::chrono::steady_clock> time_point_;
+    mutable std::chrono::microseconds wake_overshoot_{100}; // Initial guess
     WindowInfo win_info_;
+    mutable CommandBuffer command_buffers_[2];
+    mutable std::size_t record_index_{0};
+    mutable FrameStats frame_stats_;
     std::unique_ptr<SDLWindowWrapper> ps_win_;
+    std::unique_ptr<RenderThread> ps_render_; // Must be destroyed first
+
+    void limit_sleep(std::chrono::microseconds wait) const noexcept;
+    void limit_hybrid(std::chrono::steady_clock::time_point target)
+            const noexcept;
 };
 
 } // namespace Greenbell
@@ -0,0 +1,21 @@
+// Pass or fail reporting for the tests, which exit non zero if any failed
+#ifndef GB_TESTS_CHECK_H
+#define GB_TESTS_CHECK_H
+
+#include "gb_fmt.h"
+
+namespace Greenbell::Test {
+
+inline bool failed = false;
+
+inline void Check(bool ok, const char* what) {
+    fmt::print("{:<40} {}\n", what, ok ? "ok" : "FAILED");
+    if (!ok) failed = true;
+}
+
+inline int Result() noexcept {
+    return failed ? 1 : 0;
+}
+
+} // namespace Greenbell::Test
+#endif
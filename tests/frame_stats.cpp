@@ -0,0 +1,81 @@
+// Checks FrameStats percentiles and the sliding window, and that it can be
+// read while another thread records
+#include "frame_stats.h"
+#include "check.h"
+#include "gb_fmt.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+using namespace Greenbell;
+using std::chrono::microseconds;
+
+static bool Near(microseconds value, std::int64_t expected) {
+    // Histogram buckets are within about 6%
+    const auto error = value.count() - expected;
+    return error * 100 <= expected * 7 && -error * 100 <= expected * 7;
+}
+
+int main() {
+    FrameStats stats;
+    Test::Check(stats.summary(FrameMetric::FRAME).samples == 0, "Empty");
+
+    // 1000us to 1255us so the window is full
+    for (std::int64_t i = 0; i < 256; ++i) {
+        stats.record(FrameMetric::FRAME, microseconds(1000 + i));
+    }
+    auto s = stats.summary(FrameMetric::FRAME);
+    fmt::print("mean {} p50 {} p95 {} p99 {} max {}\n", s.mean.count(),
+            s.p50.count(), s.p95.count(), s.p99.count(), s.max.count());
+    Test::Check(s.samples == FrameStats::WINDOW, "Samples");
+    Test::Check(s.mean.count() == 1127, "Mean");
+    Test::Check(s.max.count() == 1255, "Max");
+    Test::Check(Near(s.p50, 1128) && Near(s.p95, 1243) && Near(s.p99, 1253),
+            "Percentiles");
+
+    // A spike is reported then forgotten once it leaves the window
+    stats.record(FrameMetric::FRAME, microseconds(50000));
+    s = stats.summary(FrameMetric::FRAME);
+    Test::Check(s.max.count() == 50000 &&
+            stats.last(FrameMetric::FRAME).count() == 50000, "Spike");
+    for (auto i = 0; i < 256; ++i) {
+        stats.record(FrameMetric::FRAME, microseconds(2000));
+    }
+    s = stats.summary(FrameMetric::FRAME);
+    Test::Check(s.max.count() == 2000 && Near(s.p99, 2000) &&
+            s.mean.count() == 2000, "Window slides");
+    Test::Check(stats.count(FrameMetric::FRAME) == 513, "Count");
+
+    // Counters are summarised the same way, without being times
+    for (std::uint64_t i = 0; i < 100; ++i) {
+        stats.record(FrameCounter::STATE_SKIPPED, 10 * i);
+    }
+    const auto c = stats.summary(FrameCounter::STATE_SKIPPED);
+    Test::Check(c.samples == 100 && c.max == 990 && c.mean == 495 &&
+            stats.last(FrameCounter::STATE_SKIPPED) == 990 &&
+            stats.count(FrameCounter::STATE_SKIPPED) == 100, "Counter");
+    Test::Check(stats.count(FrameMetric::CPU) == 0, "Counters separate");
+
+    // Readers on another thread while recording
+    std::atomic<bool> done{false};
+    std::atomic<bool> bad{false};
+    std::thread reader([&stats, &done, &bad]() {
+        while (!done) {
+            const auto r = stats.summary(FrameMetric::CPU);
+            if (r.samples && (r.max.count() > 899 || r.p50 > r.max)) {
+                bad = true;
+            }
+        }
+    });
+    for (std::int64_t i = 0; i < 200000; ++i) {
+        stats.record(FrameMetric::CPU, microseconds(100 + i % 800));
+    }
+    done = true;
+    reader.join();
+    Test::Check(!bad, "Concurrent reader");
+    Test::Check(stats.summary(FrameMetric::CPU).max.count() <= 899,
+            "Concurrent");
+
+    return Test::Result();
+}
@@ -0,0 +1,109 @@
+// Count heap allocations made while dispatching jobs to Greenbell::ThreadPool.
+// Once the pool has warmed up dispatching should not allocate at all.
+#include "thread_pool.h"
+#include "gb_fmt.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <thread>
+
+namespace {
+
+std::atomic<bool> counting{false};
+std::atomic<std::size_t> allocations{0};
+
+constexpr int BATCH_SIZE = 1000;
+constexpr int DISPATCH_COUNT = 1000000;
+
+// A capture that is too big for the small buffer in std::function
+struct Payload {
+    std::array<std::uint64_t, 5> values{1, 2, 3, 4, 5};
+    std::atomic<std::uint64_t>* p_sum{nullptr};
+};
+
+void WaitFor(const std::atomic<int>& done, int count) {
+    while (done.load() < count) std::this_thread::yield();
+}
+
+// Dispatch in batches, waiting for each batch so the queues stay bounded
+void Run(Greenbell::ThreadPool& pool, std::atomic<int>& done,
+        std::atomic<std::uint64_t>& sum, int count) {
+    Payload payload{};
+    payload.p_sum = &sum;
+    for (int i = 0; i < count; i += BATCH_SIZE) {
+        done = 0;
+        for (int j = 0; j < BATCH_SIZE; ++j) {
+            pool.dispatch([payload, &done]() {
+                payload.p_sum->fetch_add(payload.values[4],
+                        std::memory_order_relaxed);
+                done.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+        WaitFor(done, BATCH_SIZE);
+    }
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (size == 0) size = 1;
+    if (void* p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t /* size */) noexcept {
+    std::free(p);
+}
+
+int main() {
+    // The same capture in std::function, which is what jobs used to be
+    counting = true;
+    {
+        std::atomic<std::uint64_t> sum{0};
+        Payload payload{};
+        payload.p_sum = &sum;
+        for (int i = 0; i < BATCH_SIZE; ++i) {
+            std::function<void(void)> f{[payload]() {
+                payload.p_sum->fetch_add(payload.values[4]);
+            }};
+            f();
+        }
+    }
+    counting = false;
+    fmt::print("std::function: {} allocations for {} jobs\n",
+            allocations.load(), BATCH_SIZE);
+
+    Greenbell::ThreadPool pool{std::max(std::thread::hardware_concurrency(),
+            2u)};
+    std::atomic<int> done{0};
+    std::atomic<std::uint64_t> sum{0};
+
+    // Warm up so every worker's ring has grown to fit a whole batch
+    Run(pool, done, sum, BATCH_SIZE * 10);
+
+    allocations = 0;
+    counting = true;
+    Run(pool, done, sum, DISPATCH_COUNT);
+    counting = false;
+
+    const auto count = allocations.load();
+    fmt::print("ThreadPool: {} allocations for {} dispatches\n", count,
+            DISPATCH_COUNT);
+    if (count != 0) {
+        fmt::print("FAILED: steady state dispatch allocated\n");
+        return 1;
+    }
+    fmt::print("PASSED\n");
+    return 0;
+}
@@ -0,0 +1,88 @@
+// Checks GB_LOG formats each argument type the same way Log::Write does, both
+// immediately and through the background thread
+#include "log.h"
+#include "check.h"
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+using namespace Greenbell;
+
+static std::ostringstream captured;
+
+// Everything written since the last call
+static std::string Take() {
+    auto text = captured.str();
+    captured.str("");
+    return text;
+}
+
+static void Types(const char* when) {
+    const auto min = std::numeric_limits<std::int64_t>::min();
+    const auto max = std::numeric_limits<std::uint64_t>::max();
+    const std::string_view view{"viewed and cut", 6};
+    const char* name = "name";
+    const char* none = nullptr;
+    auto* p = reinterpret_cast<void*>(std::uintptr_t{0x1234});
+    std::string expected;
+
+    GB_LOG(LOG_INFO, "%d %d|%d %d|%d %d|%d", true, false, 'x', -7, min, 42u,
+            max);
+    Log::Write(LOG_INFO, "%d %d|%d %d|%d %d|%d", true, false, 'x', -7, min,
+            42u, max);
+    Log::Flush();
+    auto text = Take();
+    expected = "1 0|x -7|-9223372036854775808 42|18446744073709551615\n";
+    Test::Check(text == expected + expected, when);
+
+    GB_LOG(LOG_INFO, "%f %f %p [%s] [%s]", 1.5, 0.25f, p, view, name);
+    Log::Write(LOG_INFO, "%f %f %p [%s] [%s]", 1.5, 0.25f, p, view, name);
+    Log::Flush();
+    text = Take();
+    expected = "1.5 0.25 0x1234 [viewed] [name]\n";
+    Test::Check(text == expected + expected, "Floats, pointers and strings");
+
+    // A null const char* is logged as empty, Write can't take one
+    GB_LOG(LOG_INFO, "[%s] [%s]", none, std::string{"copied"});
+    Log::Flush();
+    Test::Check(Take() == "[] [copied]\n", "Null and temporary strings");
+
+    // Small integer types are numbers, see ArgType
+    GB_LOG(LOG_INFO, "%d %d %d", std::uint8_t{200}, std::int8_t{-3},
+            std::int16_t{-300});
+    Log::Flush();
+    Test::Check(Take() == "200 -3 -300\n", "8 bit integers");
+}
+
+int main() {
+    auto* p_old = std::cout.rdbuf(captured.rdbuf());
+    Log::SetLevel(LOG_TRACE);
+
+    // '%%' is one '%', and a '%' at the end takes an argument too
+    GB_LOG(LOG_INFO, "No arguments");
+    GB_LOG(LOG_INFO, "100%% %d%%, %", 50, '!');
+    GB_LOG(LOG_INFO, "%%%%");
+    Log::Write(LOG_INFO, "100%% %d%%, %", 50, '!');
+    Test::Check(Take() == "No arguments\n100% 50%, !\n%%\n100% 50%, !\n",
+            "Percent signs");
+
+    Types("Immediate");
+    Log::StartAsync();
+    Types("Async");
+    Log::StopAsync();
+
+    // Levels are filtered at run time, and at compile time past
+    // GB_LOG_COMPILE_LEVEL where the arguments aren't even evaluated
+    auto evaluated = 0;
+    Log::SetLevel(LOG_INFO);
+    GB_LOG(LOG_TRACE, "Hidden %d", ++evaluated);
+    Test::Check(Take().empty() &&
+            evaluated == (Log::Compiled(LOG_TRACE) ? 1 : 0), "Run time level");
+    static_assert(Log::Compiled(LOG_ERROR), "Errors are always compiled");
+
+    std::cout.rdbuf(p_old);
+    return Test::Result();
+}
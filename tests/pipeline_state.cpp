@@ -0,0 +1,54 @@
+// Checks PipelineCache makes one pipeline per distinct description, and that
+// the sort key orders pipelines by the cost of changing between them
+#include "pipeline_state.h"
+#include "check.h"
+#include <algorithm>
+#include <vector>
+
+using namespace Greenbell;
+
+int main() {
+    PipelineCache cache;
+    PipelineDesc opaque;
+    opaque.program = 1;
+    opaque.vao = 1;
+    const auto& a = cache.get(opaque);
+    Test::Check(&cache.get(opaque) == &a && cache.size() == 1, "Same desc");
+
+    // Blend factors are unused while blend is off
+    auto unused = opaque;
+    unused.blend_source = GL_ONE;
+    unused.blend_destination = GL_ZERO;
+    unused.blend_equation = GL_MAX;
+    Test::Check(unused == opaque && cache.get(unused).id() == a.id() &&
+            cache.size() == 1, "Unused blend factors");
+
+    // but not once it is on
+    auto blended = opaque;
+    blended.blend = true;
+    auto added = blended;
+    added.blend_destination = GL_ONE;
+    const auto& b = cache.get(blended);
+    const auto& c = cache.get(added);
+    Test::Check(b.id() != a.id() && c.id() != b.id() && cache.size() == 3,
+            "Blend factors");
+
+    // A different VAO sorts next to the same state rather than next to the
+    // same VAO with blending
+    auto other_vao = opaque;
+    other_vao.vao = 2;
+    auto depth = opaque;
+    depth.depth_func = GL_LEQUAL;
+    std::vector<const PipelineState*> sorted{&c, &cache.get(depth), &b,
+            &cache.get(other_vao), &a};
+    std::sort(sorted.begin(), sorted.end(),
+            [](const PipelineState* x, const PipelineState* y) {
+                return *x < *y;
+            });
+    Test::Check(sorted[0] == &a && sorted[1]->desc() == other_vao &&
+            sorted[2]->desc() == depth && sorted[3] == &c && sorted[4] == &b,
+            "Sort by cost");
+    Test::Check(a.sort_key() >> 48 == 1, "Program on top");
+
+    return Test::Result();
+}
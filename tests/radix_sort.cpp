@@ -0,0 +1,59 @@
+// Checks RadixSort against std::stable_sort and times the two
+#include "radix_sort.h"
+#include "check.h"
+#include "gb_fmt.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace Greenbell;
+using Clock = std::chrono::steady_clock;
+
+static bool Same(const std::vector<SortItem>& a,
+        const std::vector<SortItem>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+            [](const SortItem& x, const SortItem& y) {
+                return x.key == y.key && x.index == y.index;
+            });
+}
+
+int main() {
+    std::mt19937_64 random{1};
+    std::vector<SortItem> scratch;
+    const auto by_key = [](const SortItem& a, const SortItem& b) {
+        return a.key < b.key;
+    };
+
+    // Full width keys, and draw list style keys with few distinct values
+    // so equal keys must keep their order
+    for (const auto mask : {~std::uint64_t{0}, std::uint64_t{0x0F000F000F}}) {
+        std::vector<SortItem> items(100000);
+        for (std::uint32_t i = 0; i < items.size(); ++i) {
+            items[i] = SortItem{random() & mask, i};
+        }
+        auto expected = items;
+
+        auto start = Clock::now();
+        std::stable_sort(expected.begin(), expected.end(), by_key);
+        const auto std_time = Clock::now() - start;
+        start = Clock::now();
+        RadixSort(items, scratch);
+        const auto radix_time = Clock::now() - start;
+
+        fmt::print("stable_sort {}us RadixSort {}us\n",
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                        std_time).count(),
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                        radix_time).count());
+        Test::Check(Same(items, expected), mask == ~std::uint64_t{0} ?
+                "Full keys" : "Sparse keys stable");
+    }
+
+    std::vector<SortItem> one{{5, 0}};
+    RadixSort(one, scratch);
+    Test::Check(one.size() == 1 && one[0].key == 5, "Single item");
+
+    return Test::Result();
+}
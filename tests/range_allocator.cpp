@@ -0,0 +1,74 @@
+// Checks RangeAllocator best fit, alignment and merging of freed ranges
+#include "range_allocator.h"
+#include "check.h"
+#include <cstddef>
+#include <random>
+#include <vector>
+
+using namespace Greenbell;
+
+int main() {
+    RangeAllocator a{1000};
+    const auto r0 = a.allocate(100);
+    const auto r1 = a.allocate(200);
+    const auto r2 = a.allocate(100);
+    Test::Check(r0 == 0 && r1 == 100 && r2 == 300, "Sequential");
+    Test::Check(a.free_space() == 600 && a.free_ranges() == 1, "Free space");
+    Test::Check(a.allocate(601) == RangeAllocator::NONE, "Too big");
+
+    // Best fit picks the 100 gap at the start over the tail
+    a.free(r0, 100);
+    a.free(r1, 0); // Zero size is ignored
+    Test::Check(a.free_ranges() == 2, "Gap");
+    a.free(r2, 100);
+    Test::Check(a.free_ranges() == 2 && a.fragmentation() > 0.0f, "Two gaps");
+    Test::Check(a.allocate(50) == 0, "Best fit");
+    a.free(0, 50);
+
+    // Freeing the middle merges everything back into one range
+    a.free(r1, 200);
+    Test::Check(a.free_ranges() == 1 && a.largest_free() == 1000 &&
+            a.fragmentation() < 0.001f, "Merge");
+
+    // Alignment padding goes back on the free list
+    RangeAllocator b{1024};
+    b.allocate(3);
+    const auto aligned = b.allocate(16, 256);
+    Test::Check(aligned == 256, "Aligned");
+    Test::Check(b.free_space() == 1024 - 3 - 16 && b.allocate(253) == 3,
+            "Padding reused");
+
+    // Random churn never hands out overlapping ranges and gives back
+    // everything in the end
+    RangeAllocator c{1 << 16};
+    std::vector<std::pair<std::size_t, std::size_t>> live;
+    std::vector<char> used(1 << 16, 0);
+    std::mt19937 random{1};
+    auto overlap = false;
+    for (auto i = 0; i < 20000; ++i) {
+        if (live.empty() || random() % 3) {
+            const std::size_t size = 1 + random() % 500;
+            const auto offset = c.allocate(size, std::size_t{1} <<
+                    (random() % 5));
+            if (offset == RangeAllocator::NONE) continue;
+            for (auto j = offset; j < offset + size; ++j) {
+                if (used[j]) overlap = true;
+                used[j] = 1;
+            }
+            live.emplace_back(offset, size);
+        } else {
+            const auto k = random() % live.size();
+            const auto [offset, size] = live[k];
+            for (auto j = offset; j < offset + size; ++j) used[j] = 0;
+            c.free(offset, size);
+            live[k] = live.back();
+            live.pop_back();
+        }
+    }
+    Test::Check(!overlap, "No overlaps");
+    for (const auto& [offset, size] : live) c.free(offset, size);
+    Test::Check(c.free_ranges() == 1 && c.free_space() == c.capacity(),
+            "All merged");
+
+    return Test::Result();
+}
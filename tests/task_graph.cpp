@@ -0,0 +1,66 @@
+// Checks TaskGraph ordering, cycle detection and the critical path
+#include "task_graph.h"
+#include "check.h"
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace Greenbell;
+using std::chrono::milliseconds;
+
+int main() {
+    ThreadPool pool{4};
+
+    // A cycle can't be ordered, so running is refused
+    {
+        std::atomic<int> ran{0};
+        TaskGraph cycle;
+        const auto a = cycle.add("A", [&ran]() { ++ran; });
+        const auto b = cycle.add("B", [&ran]() { ++ran; }, {a});
+        const auto c = cycle.add("C", [&ran]() { ++ran; }, {b});
+        cycle.precede(c, a);
+        auto threw = false;
+        try {
+            cycle.run(pool);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        Test::Check(threw && ran == 0, "Cycle rejected");
+    }
+
+    // Diamond where the C side is slower, so the path is A C D
+    TaskGraph diamond;
+    std::atomic<int> step{0};
+    std::vector<int> finished(4, -1);
+    const auto Task = [&step, &finished](int index, milliseconds sleep) {
+        return [&step, &finished, index, sleep]() {
+            std::this_thread::sleep_for(sleep);
+            finished[static_cast<std::size_t>(index)] = step++;
+        };
+    };
+    const auto a = diamond.add("A", Task(0, milliseconds(5)));
+    const auto b = diamond.add("B", Task(1, milliseconds(1)), {a});
+    const auto c = diamond.add("C", Task(2, milliseconds(30)), {a});
+    const auto d = diamond.add("D", Task(3, milliseconds(5)), {b, c});
+    diamond.run(pool);
+
+    Test::Check(finished[0] == 0 && finished[3] == 3, "Diamond order");
+    const auto& path = diamond.critical_path_tasks();
+    Test::Check(path == std::vector<TaskGraph::TaskId>{a, c, d},
+            "Critical path tasks");
+    Test::Check(diamond.critical_path() == diamond.duration(a) +
+            diamond.duration(c) + diamond.duration(d), "Critical path length");
+    Test::Check(diamond.critical_path() >= milliseconds(40) &&
+            diamond.critical_path() <= diamond.wall_time(),
+            "Critical path in wall time");
+
+    // Running again reuses the compiled graph
+    step = 0;
+    diamond.run(pool);
+    Test::Check(finished[3] == 3 && diamond.critical_path_tasks().size() == 3,
+            "Second run");
+
+    return Test::Result();
+}
@@ -0,0 +1,286 @@
+// Throughput of Greenbell::ThreadPool compared with the original single queue
+// design, for 1 up to the number of hardware threads. Then a 1M element
+// transform loop run serially, with one job per element and with parallel_for.
+// Finally dispatch latency and throughput with 1, 4 and 16 producer threads
+// for each queue design.
+#include "thread_pool.h"
+#include "gb_fmt.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// The original ThreadPool: every dispatch and every wakeup goes through one
+// mutex and one queue
+class SingleQueuePool {
+    using job_t = std::function<void(void)>;
+
+  public:
+    SingleQueuePool(std::size_t thread_count) : threads_{thread_count} {
+        for (auto& t : threads_) {
+            t = std::thread(&SingleQueuePool::thread_handler, this);
+        }
+    }
+    ~SingleQueuePool() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            quit_ = true;
+            cv_.notify_all();
+        }
+        for (auto& t : threads_) {
+            if (t.joinable()) t.join();
+        }
+    }
+    SingleQueuePool(const SingleQueuePool&) = delete;
+    SingleQueuePool& operator=(const SingleQueuePool&) = delete;
+    SingleQueuePool(SingleQueuePool&&) = delete;
+    SingleQueuePool& operator=(SingleQueuePool&&) = delete;
+
+    void dispatch(job_t&& op) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        q_.push(std::move(op));
+        cv_.notify_one();
+    }
+
+  private:
+    std::mutex mutex_;
+    std::queue<job_t> q_;
+    std::condition_variable cv_;
+    std::vector<std::thread> threads_;
+    bool quit_ = false;
+
+    void thread_handler() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        while (!quit_) {
+            cv_.wait(lock, [this]() { return (!q_.empty() || quit_); });
+            if (!q_.empty() && !quit_) {
+                auto job_function = std::move(q_.front());
+                q_.pop();
+                lock.unlock();
+                job_function();
+                lock.lock();
+            }
+        }
+    }
+};
+
+constexpr int JOB_COUNT = 200000;
+constexpr int ROOT_COUNT = 64;
+constexpr int SPIN_COUNT = 200; // Work per job, roughly a few hundred ns
+
+void Work(std::atomic<int>& done) {
+    volatile int sink = 0;
+    for (int i = 0; i < SPIN_COUNT; ++i) sink = sink + i;
+    done.fetch_add(1, std::memory_order_relaxed);
+}
+
+// How a job spawns more jobs from inside the pool
+template <typename F>
+void Spawn(SingleQueuePool& pool, F&& op) {
+    pool.dispatch(std::forward<F>(op));
+}
+template <typename F>
+void Spawn(Greenbell::ThreadPool& pool, F&& op) {
+    pool.dispatch_local(std::forward<F>(op));
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+void WaitFor(const std::atomic<int>& done, int count) {
+    while (done.load() < count) std::this_thread::yield();
+}
+
+// Every job dispatched from the main thread
+template <typename Pool>
+double ExternalRate(std::size_t thread_count) {
+    Pool pool{thread_count};
+    std::atomic<int> done{0};
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < JOB_COUNT; ++i) {
+        pool.dispatch([&done]() { Work(done); });
+    }
+    WaitFor(done, JOB_COUNT);
+    return JOB_COUNT / Seconds(start);
+}
+
+// A few root jobs which each spawn many small jobs from inside the pool
+template <typename Pool>
+double FanOutRate(std::size_t thread_count) {
+    Pool pool{thread_count};
+    std::atomic<int> done{0};
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROOT_COUNT; ++r) {
+        pool.dispatch([&pool, &done]() {
+            for (int i = 0; i < JOB_COUNT / ROOT_COUNT; ++i) {
+                Spawn(pool, [&done]() { Work(done); });
+            }
+        });
+    }
+    WaitFor(done, JOB_COUNT);
+    return JOB_COUNT / Seconds(start);
+}
+
+constexpr std::size_t ELEMENT_COUNT = 1000000;
+constexpr std::size_t GRAIN = 1024;
+
+struct Vec {
+    float x;
+    float y;
+    float z;
+    float w;
+};
+
+// Column major 4x4 matrix times vector
+Vec Apply(const float* m, const Vec& v) {
+    return Vec{m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12] * v.w,
+            m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13] * v.w,
+            m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14] * v.w,
+            m[3] * v.x + m[7] * v.y + m[11] * v.z + m[15] * v.w};
+}
+
+double Milliseconds(std::chrono::steady_clock::time_point start) {
+    return Seconds(start) * 1000.0;
+}
+
+void TransformBench(std::size_t thread_count) {
+    static constexpr float m[16] = {0.0f, 1.0f, 0.0f, 0.0f, -1.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 5.0f, 6.0f, 7.0f, 1.0f};
+    std::vector<Vec> in(ELEMENT_COUNT);
+    for (std::size_t i = 0; i < ELEMENT_COUNT; ++i) {
+        const auto f = static_cast<float>(i % 1000);
+        in[i] = Vec{f, 2.0f * f, 3.0f * f, 1.0f};
+    }
+    std::vector<Vec> out(ELEMENT_COUNT);
+    Greenbell::ThreadPool pool{thread_count};
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < ELEMENT_COUNT; ++i) out[i] = Apply(m, in[i]);
+    const auto serial = Milliseconds(start);
+
+    start = std::chrono::steady_clock::now();
+    Greenbell::JobGroup group;
+    for (std::size_t i = 0; i < ELEMENT_COUNT; ++i) {
+        pool.dispatch(group, [&in, &out, i]() { out[i] = Apply(m, in[i]); });
+    }
+    pool.wait(group);
+    const auto per_element = Milliseconds(start);
+
+    start = std::chrono::steady_clock::now();
+    pool.parallel_for(std::size_t{0}, ELEMENT_COUNT, GRAIN,
+            [&in, &out](std::size_t i) { out[i] = Apply(m, in[i]); });
+    const auto parallel = Milliseconds(start);
+
+    // Check the results with a reduce so it gets some use too
+    const auto sum = pool.parallel_reduce(std::size_t{0}, ELEMENT_COUNT, GRAIN,
+            0.0, [&out](std::size_t i) { return static_cast<double>(out[i].x); },
+            [](double a, double b) { return a + b; });
+    double expected = 0.0;
+    for (const auto& v : out) expected += static_cast<double>(v.x);
+
+    fmt::print("{:7} {:10.2f} {:15.2f} {:16.2f}   {}\n", thread_count, serial,
+            per_element, parallel,
+            (std::abs(sum - expected) < 1.0) ? "ok" : "MISMATCH");
+}
+
+constexpr int PRODUCER_JOBS = 20000;
+
+// Every producer dispatches jobs as fast as it can and each job records how
+// long it waited between dispatch and starting to run
+template <typename Pool>
+void ProducerBench(const char* label, Pool& pool, std::size_t producers) {
+    const auto total = producers * PRODUCER_JOBS;
+    std::vector<std::int64_t> latency(total);
+    std::atomic<std::size_t> next{0};
+    std::atomic<int> done{0};
+    std::atomic<bool> go{false};
+
+    std::vector<std::thread> threads;
+    for (std::size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&pool, &latency, &next, &done, &go]() {
+            while (!go) std::this_thread::yield();
+            for (int i = 0; i < PRODUCER_JOBS; ++i) {
+                const auto sent = std::chrono::steady_clock::now();
+                pool.dispatch([&latency, &next, &done, sent]() {
+                    const auto wait = std::chrono::steady_clock::now() - sent;
+                    latency[next++] = std::chrono::duration_cast<
+                            std::chrono::nanoseconds>(wait).count();
+                    done.fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+        });
+    }
+    const auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto& t : threads) t.join();
+    WaitFor(done, static_cast<int>(total));
+    const auto rate = static_cast<double>(total) / Seconds(start);
+
+    std::sort(latency.begin(), latency.end());
+    fmt::print("{:20} {:9} {:12.0f} {:11} {:11} {:11}\n", label, producers,
+            rate, latency[total / 2], latency[total * 99 / 100],
+            latency.back());
+}
+
+} // namespace
+
+int main() {
+    const std::size_t max_threads =
+            std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::size_t> counts;
+    for (std::size_t n = 1; n < max_threads; n *= 2) counts.push_back(n);
+    counts.push_back(max_threads);
+
+    fmt::print("{} jobs, {} hardware threads, results in jobs/s\n", JOB_COUNT,
+            max_threads);
+    fmt::print("threads   single dispatch   stealing dispatch"
+               "   single fan out   stealing fan out\n");
+    for (const auto n : counts) {
+        const auto sd = ExternalRate<SingleQueuePool>(n);
+        const auto wd = ExternalRate<Greenbell::ThreadPool>(n);
+        const auto sf = FanOutRate<SingleQueuePool>(n);
+        const auto wf = FanOutRate<Greenbell::ThreadPool>(n);
+        fmt::print("{:7} {:17.0f} {:19.0f} {:16.0f} {:18.0f}\n", n, sd, wd,
+                sf, wf);
+    }
+
+    fmt::print("\n{} element transform, results in ms\n", ELEMENT_COUNT);
+    fmt::print("threads     serial     per element     parallel_for\n");
+    for (const auto n : counts) {
+        TransformBench(n);
+    }
+
+    fmt::print("\nDispatch from producer threads to {} workers, latency in ns\n",
+            max_threads);
+    fmt::print("queue                producers       jobs/s     latency p50"
+               "         p99         max\n");
+    static constexpr std::size_t producer_counts[] = {1, 4, 16};
+    for (const auto producers : producer_counts) {
+        {
+            SingleQueuePool pool{max_threads};
+            ProducerBench("single queue", pool, producers);
+        }
+        {
+            Greenbell::ThreadPool pool{max_threads,
+                    Greenbell::PoolQueue::WORK_STEALING};
+            ProducerBench("work stealing", pool, producers);
+        }
+        {
+            Greenbell::ThreadPool pool{max_threads,
+                    Greenbell::PoolQueue::MPMC_RING};
+            ProducerBench("mpmc ring", pool, producers);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,231 @@
+// Turns a binary log written by Log::OpenBinary back into text
+#include "log.h"
+#include "log_file.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace Greenbell;
+using Log::LogArg;
+using Log::LogFormat;
+using Log::LogPiece;
+
+// A FORMAT entry, with a LogFormat pointing into it for DecodeRecord
+struct Format {
+    std::string text;
+    std::vector<LogPiece> pieces;
+    std::vector<LogArg> args;
+    LogFormat info{};
+};
+
+// Far bigger than any entry the writer makes, so a corrupt size can't
+// allocate everything
+static constexpr std::uint32_t MAX_SIZE = 1 << 24;
+
+// How reading the entries ended
+enum class End { COMPLETE, PARTIAL, CORRUPT };
+
+template <typename T>
+static bool Read(std::ifstream& file, T& value) {
+    char bytes[sizeof(T)];
+    if (!file.read(bytes, sizeof(T))) return false;
+    std::memcpy(&value, bytes, sizeof(T));
+    return true;
+}
+
+static bool Read(std::ifstream& file, std::string& text, std::uint32_t size) {
+    text.resize(size);
+    return size == 0 || static_cast<bool>(file.read(&text[0], size));
+}
+
+static End ReadFormat(std::ifstream& file,
+        std::vector<std::unique_ptr<Format>>& formats) {
+    std::uint32_t id = 0;
+    std::uint8_t level = 0;
+    std::uint32_t length = 0;
+    auto p_format = std::make_unique<Format>();
+    auto& f = *p_format;
+    if (!Read(file, id) || !Read(file, level) || !Read(file, length)) {
+        return End::PARTIAL;
+    }
+    // Ids are given out in order
+    if (id > formats.size() || level > LOG_TRACE || length > MAX_SIZE) {
+        return End::CORRUPT;
+    }
+    if (!Read(file, f.text, length)) return End::PARTIAL;
+    std::uint32_t count = 0;
+    if (!Read(file, count)) return End::PARTIAL;
+    // Every piece but the last uses at least one character of the text
+    if (count > length + 1) return End::CORRUPT;
+    f.pieces.resize(count);
+    std::size_t arg_pieces = 0;
+    for (auto& piece : f.pieces) {
+        std::uint8_t arg = 0;
+        if (!Read(file, piece.offset) || !Read(file, piece.length) ||
+                !Read(file, arg)) {
+            return End::PARTIAL;
+        }
+        if (piece.offset > length || piece.length > length - piece.offset) {
+            return End::CORRUPT;
+        }
+        piece.arg = arg;
+        if (arg) ++arg_pieces;
+    }
+    if (!Read(file, count)) return End::PARTIAL;
+    if (count != arg_pieces) return End::CORRUPT;
+    f.args.resize(count);
+    for (auto& arg : f.args) {
+        std::uint8_t type = 0;
+        if (!Read(file, type)) return End::PARTIAL;
+        if (type > static_cast<std::uint8_t>(LogArg::STRING)) {
+            return End::CORRUPT;
+        }
+        arg = static_cast<LogArg>(type);
+    }
+    f.info = LogFormat{f.text.c_str(), static_cast<LogLevel>(level),
+            f.pieces.data(), f.pieces.size(), f.args.data(), f.args.size()};
+    if (formats.size() == id) formats.emplace_back();
+    formats[id] = std::move(p_format);
+    return End::COMPLETE;
+}
+
+static const char* LevelName(LogLevel level) {
+    switch (level) {
+        case LOG_ERROR: return "ERROR";
+        case LOG_INFO: return "INFO ";
+        case LOG_TRACE: return "TRACE";
+        default: return "?????";
+    }
+}
+
+// A message read from the file
+struct Line {
+    std::int64_t time;
+    std::uint32_t thread;
+    LogLevel level;
+    const std::string& text;
+};
+
+// Reads the entries after the magic, calling on_line with each message and
+// on_dropped with each count of dropped messages. Stops at the end of the
+// file, part way through an entry or at the first entry which doesn't make
+// sense.
+template <typename L, typename D>
+static End ReadEntries(std::ifstream& file, L&& on_line, D&& on_dropped) {
+    std::vector<std::unique_ptr<Format>> formats;
+    std::string data;
+    std::string text;
+    std::uint8_t entry = 0;
+    while (Read(file, entry)) {
+        if (entry == LogFile::FORMAT) {
+            const auto end = ReadFormat(file, formats);
+            if (end != End::COMPLETE) return end;
+        } else if (entry == LogFile::RECORD || entry == LogFile::TEXT) {
+            std::uint32_t id = 0;
+            std::uint8_t level = 0;
+            std::uint32_t thread = 0;
+            std::int64_t time = 0;
+            std::uint32_t size = 0;
+            const auto ok = (entry == LogFile::RECORD) ? Read(file, id) :
+                    Read(file, level);
+            if (!ok || !Read(file, thread) || !Read(file, time) ||
+                    !Read(file, size)) {
+                return End::PARTIAL;
+            }
+            if (level > LOG_TRACE || size > MAX_SIZE) return End::CORRUPT;
+            if (!Read(file, data, size)) return End::PARTIAL;
+            if (entry == LogFile::TEXT) {
+                on_line(Line{time, thread, static_cast<LogLevel>(level),
+                        data});
+            } else if (id < formats.size() && formats[id]) {
+                const auto& format = formats[id]->info;
+                text.clear();
+                if (!Log::DecodeRecord(format, data.data(), data.size(),
+                        text)) {
+                    return End::CORRUPT;
+                }
+                on_line(Line{time, thread, format.level, text});
+            } else {
+                return End::CORRUPT;
+            }
+        } else if (entry == LogFile::DROPPED) {
+            std::uint64_t count = 0;
+            if (!Read(file, count)) return End::PARTIAL;
+            on_dropped(count);
+        } else {
+            return End::CORRUPT;
+        }
+    }
+    return End::COMPLETE;
+}
+
+static void PrintLine(std::int64_t start, const Line& line) {
+    // Seconds since the earliest message. Unsigned so a damaged time can't
+    // overflow, start is the earliest so the difference is never negative.
+    const auto ns = static_cast<std::uint64_t>(line.time) -
+            static_cast<std::uint64_t>(start);
+    std::printf("[%6llu.%06llu] T%-3u %s %s\n",
+            static_cast<unsigned long long>(ns / 1000000000),
+            static_cast<unsigned long long>((ns % 1000000000) / 1000),
+            line.thread, LevelName(line.level), line.text.c_str());
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::fprintf(stderr, "Usage: log_decode <binary log file>\n");
+        return 1;
+    }
+    std::ifstream file{argv[1], std::ios::binary};
+    char magic[sizeof(LogFile::MAGIC)];
+    if (!file.read(magic, sizeof(magic)) ||
+            std::memcmp(magic, LogFile::MAGIC, sizeof(magic)) != 0) {
+        std::fprintf(stderr, "%s is not a Greenbell binary log\n", argv[1]);
+        return 1;
+    }
+
+    // Each thread's messages are written in batches, so the file isn't in
+    // time order. Find the earliest message first so times are relative to
+    // that.
+    const auto entries = file.tellg();
+    auto start = std::numeric_limits<std::int64_t>::max();
+    ReadEntries(file,
+            [&start](const Line& line) {
+                start = std::min(start, line.time);
+            },
+            [](std::uint64_t) {});
+    if (start != std::numeric_limits<std::int64_t>::max()) {
+        // Wall clock time of the earliest message, if it is a real date
+        const auto seconds = static_cast<std::time_t>(start / 1000000000);
+        const auto* p_time = std::gmtime(&seconds);
+        char date[64];
+        if (p_time && std::strftime(date, sizeof(date),
+                "%Y-%m-%d %H:%M:%S UTC", p_time)) {
+            std::printf("Log started %s\n", date);
+        }
+    }
+
+    file.clear();
+    file.seekg(entries);
+    const auto end = ReadEntries(file,
+            [start](const Line& line) { PrintLine(start, line); },
+            [](std::uint64_t count) {
+                std::printf("*** %llu messages dropped\n",
+                        static_cast<unsigned long long>(count));
+            });
+    if (end == End::PARTIAL) {
+        // Normal for a log which was still being written
+        std::fprintf(stderr, "Log ends part way through an entry\n");
+    } else if (end == End::CORRUPT) {
+        std::fprintf(stderr, "Corrupt record, the rest of the log is "
+                "skipped\n");
+        return 1;
+    }
+    return 0;
+}